@@ -22,7 +22,7 @@ static jsmntok_t *jsmn_alloc_token(jsmn_parser *parser,
  * Fills token type and boundaries.
  */
 static void jsmn_fill_token(jsmntok_t *token, jsmntype_t type,
-                            int start, int end) {
+                            ptrdiff_t start, ptrdiff_t end) {
 	token->type = type;
 	token->start = start;
 	token->end = end;
@@ -35,7 +35,7 @@ static void jsmn_fill_token(jsmntok_t *token, jsmntype_t type,
 static int jsmn_parse_primitive(jsmn_parser *parser, const char *js,
 		size_t len, jsmntok_t *tokens, size_t num_tokens) {
 	jsmntok_t *token;
-	int start;
+	size_t start;
 
 	start = parser->pos;
 
@@ -85,7 +85,7 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
 		size_t len, jsmntok_t *tokens, size_t num_tokens) {
 	jsmntok_t *token;
 
-	int start = parser->pos;
+	size_t start = parser->pos;
 
 	parser->pos++;
 
@@ -148,12 +148,12 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
 /**
  * Parse JSON string and fill tokens.
  */
-int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
-		jsmntok_t *tokens, unsigned int num_tokens) {
+ptrdiff_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
+		jsmntok_t *tokens, size_t num_tokens) {
 	int r;
-	int i;
+	ptrdiff_t i;
 	jsmntok_t *token;
-	int count = parser->toknext;
+	ptrdiff_t count = parser->toknext;
 
 	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		char c;
@@ -176,8 +176,8 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 #endif
 				}
 				token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
-				token->start = parser->pos;
-				parser->toksuper = parser->toknext - 1;
+				token->start = (ptrdiff_t)parser->pos;
+				parser->toksuper = (ptrdiff_t)parser->toknext - 1;
 				break;
 			case '}': case ']':
 				if (tokens == NULL)
@@ -193,7 +193,7 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 						if (token->type != type) {
 							return JSMN_ERROR_INVAL;
 						}
-						token->end = parser->pos + 1;
+						token->end = (ptrdiff_t)parser->pos + 1;
 						parser->toksuper = token->parent;
 						break;
 					}
@@ -203,14 +203,14 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 					token = &tokens[token->parent];
 				}
 #else
-				for (i = parser->toknext - 1; i >= 0; i--) {
+				for (i = (ptrdiff_t)parser->toknext - 1; i >= 0; i--) {
 					token = &tokens[i];
 					if (token->start != -1 && token->end == -1) {
 						if (token->type != type) {
 							return JSMN_ERROR_INVAL;
 						}
 						parser->toksuper = -1;
-						token->end = parser->pos + 1;
+						token->end = (ptrdiff_t)parser->pos + 1;
 						break;
 					}
 				}
@@ -235,7 +235,7 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 			case '\t' : case '\r' : case '\n' : case ' ':
 				break;
 			case ':':
-				parser->toksuper = parser->toknext - 1;
+				parser->toksuper = (ptrdiff_t)parser->toknext - 1;
 				break;
 			case ',':
 				if (tokens != NULL && parser->toksuper != -1 &&
@@ -244,7 +244,7 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 #ifdef JSMN_PARENT_LINKS
 					parser->toksuper = tokens[parser->toksuper].parent;
 #else
-					for (i = parser->toknext - 1; i >= 0; i--) {
+					for (i = (ptrdiff_t)parser->toknext - 1; i >= 0; i--) {
 						if (tokens[i].type == JSMN_ARRAY || tokens[i].type == JSMN_OBJECT) {
 							if (tokens[i].start != -1 && tokens[i].end == -1) {
 								parser->toksuper = i;
@@ -288,7 +288,7 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 	}
 
 	if (tokens != NULL) {
-		for (i = parser->toknext - 1; i >= 0; i--) {
+		for (i = (ptrdiff_t)parser->toknext - 1; i >= 0; i--) {
 			/* Unmatched opened object or array */
 			if (tokens[i].start != -1 && tokens[i].end == -1) {
 				return JSMN_ERROR_PART;
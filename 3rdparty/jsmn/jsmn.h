@@ -39,14 +39,15 @@ enum jsmnerr {
  * @param		type	type (object, array, string etc.)
  * @param		start	start position in JSON data string
  * @param		end		end position in JSON data string
+ * Offsets and counts are pointer-sized, so documents over 2 GB work.
  */
 typedef struct {
 	jsmntype_t type;
-	int start;
-	int end;
-	int size;
+	ptrdiff_t start;
+	ptrdiff_t end;
+	size_t size;
 #ifdef JSMN_PARENT_LINKS
-	int parent;
+	ptrdiff_t parent;
 #endif
 } jsmntok_t;
 
@@ -55,9 +56,9 @@ typedef struct {
  * the string being parsed now and current position in that string
  */
 typedef struct {
-	unsigned int pos; /* offset in the JSON string */
-	unsigned int toknext; /* next token to allocate */
-	int toksuper; /* superior token node, e.g parent object or array */
+	size_t pos; /* offset in the JSON string */
+	size_t toknext; /* next token to allocate */
+	ptrdiff_t toksuper; /* superior token node, e.g parent object or array */
 } jsmn_parser;
 
 /**
@@ -69,8 +70,8 @@ void jsmn_init(jsmn_parser *parser);
  * Run JSON parser. It parses a JSON data string into and array of tokens, each describing
  * a single JSON object.
  */
-int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
-		jsmntok_t *tokens, unsigned int num_tokens);
+ptrdiff_t jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
+		jsmntok_t *tokens, size_t num_tokens);
 
 #ifdef __cplusplus
 }
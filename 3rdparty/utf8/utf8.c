@@ -357,9 +357,10 @@ u_int32_t createCodePointFromUtf16SurrogatePair(u_int16_t first, u_int16_t secon
 /* convert a string with literal \uxxxx or \Uxxxxxxxx characters to UTF-8
    example: u8_unescape(mybuf, 256, "hello\\u220e")
    note the double backslash is needed if called on a C string literal */
-int u8_unescape(char *buf, int sz, const char *src)
+size_t u8_unescape(char *buf, size_t sz, const char *src)
 {
-    int c=0, amt;
+    size_t c=0;
+    int amt;
     u_int32_t ch;
     char temp[4];
 
@@ -367,7 +368,7 @@ int u8_unescape(char *buf, int sz, const char *src)
     /* Откуда в строке Utf-8 могут взяться суррогатные пары Utf-16 ??? */
     u_int16_t wc[2] = {0,0};
     int sp = 0;
-    int sp_pos;
+    size_t sp_pos = 0;
     
     while (*src && c < sz)
     {
@@ -402,7 +403,7 @@ int u8_unescape(char *buf, int sz, const char *src)
             /* Обработка возможных суррогатных пар Utf-16   (КОНЕЦ) */
             
             amt = u8_wc_toutf8 (temp, ch);
-            if (amt > sz-c) break;
+            if ((size_t)amt > sz-c) break;
 
             memcpy (&buf[c], temp, amt);
         }
@@ -413,7 +414,7 @@ int u8_unescape(char *buf, int sz, const char *src)
             ch = (u_int32_t)*src;
             amt = u8_seqlen (src);
             src += amt;
-            if (amt > sz-c) break;
+            if ((size_t)amt > sz-c) break;
 
             memcpy (&buf[c], src-amt, amt);
         }
@@ -2,6 +2,7 @@
 #define UTF8_H
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint16_t u_int16_t;
@@ -56,7 +57,7 @@ int u8_read_escape_sequence(const char *src, u_int32_t *dest);
 int u8_escape_wchar(char *buf, int sz, u_int32_t ch);
 
 /* convert a string "src" containing escape sequences to UTF-8 */
-int u8_unescape(char *buf, int sz, const char *src);
+size_t u8_unescape(char *buf, size_t sz, const char *src);
 
 /* convert UTF-8 "src" to ASCII with escape sequences.
    if escape_quotes is nonzero, quote characters will be preceded by
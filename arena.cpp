@@ -0,0 +1,106 @@
+#include "arena.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+namespace
+{
+const size_t MAX_BLOCK_SIZE = 1 << 20;
+}
+
+JsonArena::JsonArena (size_t firstBlockSize)
+    : _blocks (0), _ptr (0), _end (0),
+      _nextSize (firstBlockSize ? firstBlockSize : 4096), _cleanups (0)
+{
+}
+
+JsonArena::~JsonArena ()
+{
+    runCleanups ();
+    while (_blocks)
+    {
+        Block* next = _blocks->next;
+        ::free (_blocks);
+        _blocks = next;
+    }
+}
+
+void* JsonArena::allocate (size_t size, size_t align)
+{
+    uintptr_t p = ((uintptr_t)_ptr + align - 1) & ~(uintptr_t)(align - 1);
+    if (_ptr == 0 || p + size > (uintptr_t)_end)
+    {
+        newBlock (size + align);
+        p = ((uintptr_t)_ptr + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    _ptr = (char*)(p + size);
+    return (void*)p;
+}
+
+void JsonArena::onRelease (void (*fn) (void*), void* p)
+{
+    Cleanup* c = new (allocate (sizeof (Cleanup), alignof (Cleanup))) Cleanup;
+    c->next = _cleanups;
+    c->fn = fn;
+    c->p = p;
+    _cleanups = c;
+}
+
+void JsonArena::release ()
+{
+    runCleanups ();
+    if (_blocks == 0) return;
+
+    // самый большой блок оставляем себе; это не обязательно последний:
+    // после блока под длинную строку могли выделяться обычные
+    Block* keep = _blocks;
+    for (Block* b = _blocks->next; b; b = b->next)
+    {
+        if (b->size > keep->size) keep = b;
+    }
+
+    Block* b = _blocks;
+    while (b)
+    {
+        Block* next = b->next;
+        if (b != keep) ::free (b);
+        b = next;
+    }
+    keep->next = 0;
+    _blocks = keep;
+    _ptr = (char*)(keep + 1);
+    _end = (char*)keep + keep->size;
+}
+
+size_t JsonArena::blocks () const
+{
+    size_t n = 0;
+    for (Block* b = _blocks; b; b = b->next) ++n;
+    return n;
+}
+
+void JsonArena::newBlock (size_t minSize)
+{
+    // блоки растут вдвое, чтобы большой документ занял их немного
+    size_t size = _nextSize;
+    if (size < minSize + sizeof (Block)) size = minSize + sizeof (Block);
+    if (_nextSize < MAX_BLOCK_SIZE) _nextSize *= 2;
+
+    Block* b = (Block*)::malloc (size);
+    if (b == 0) throw std::bad_alloc ();
+    b->next = _blocks;
+    b->size = size;
+    _blocks = b;
+    _ptr = (char*)(b + 1);
+    _end = (char*)b + size;
+}
+
+void JsonArena::runCleanups ()
+{
+    while (_cleanups)
+    {
+        Cleanup* c = _cleanups;
+        _cleanups = c->next;
+        c->fn (c->p);
+    }
+}
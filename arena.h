@@ -0,0 +1,109 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+///
+/// \brief JsonArena -- монотонный (bump) распределитель памяти документа.
+///
+/// Узлы, контейнеры и строки документа, разобранного или построенного
+/// с ареной, берут память из нескольких крупных блоков арены и по одному
+/// не освобождаются: разрушение такого документа почти бесплатно,
+/// а вся память возвращается разом в release() или деструкторе арены.
+///
+/// Арена должна жить дольше всех значений, которые на неё ссылаются.
+/// Изменения документа тоже берут память из арены; освобождённое
+/// при этом место до release() не переиспользуется.
+///
+class JsonArena
+{
+public:
+    explicit JsonArena (size_t firstBlockSize = 4096);
+    ~JsonArena ();
+
+    void* allocate (size_t size, size_t align = alignof (std::max_align_t));
+
+    ///
+    /// \brief onRelease регистрирует действие, выполняемое при release()
+    /// (нужно тем, кто держит память вне арены, например длинным ключам)
+    ///
+    void onRelease (void (*fn) (void*), void* p);
+
+    ///
+    /// \brief release освобождает всё, оставляя себе самый большой блок,
+    /// чтобы следующий документ обошёлся без malloc
+    ///
+    void release ();
+
+    /// число занятых блоков
+    size_t blocks () const;
+
+private:
+    JsonArena (const JsonArena&) = delete;
+    JsonArena& operator= (const JsonArena&) = delete;
+
+    struct Block
+    {
+        Block* next;
+        size_t size;
+    };
+
+    struct Cleanup
+    {
+        Cleanup* next;
+        void (*fn) (void*);
+        void* p;
+    };
+
+    void newBlock (size_t minSize);
+    void runCleanups ();
+
+    Block* _blocks;
+    char* _ptr;
+    char* _end;
+    size_t _nextSize;
+    Cleanup* _cleanups;
+};
+
+///
+/// \brief JsonAllocator -- аллокатор для стандартных и собственных
+/// контейнеров: берёт память из арены, а без арены -- из обычной кучи
+///
+template <class T>
+class JsonAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    JsonAllocator (JsonArena* arena = 0) : _arena (arena) {}
+
+    template <class U>
+    JsonAllocator (const JsonAllocator<U>& a) : _arena (a.arena ()) {}
+
+    T* allocate (size_t n)
+    {
+        if (_arena) return static_cast<T*> (_arena->allocate (n * sizeof (T), alignof (T)));
+        return static_cast<T*> (::operator new (n * sizeof (T)));
+    }
+
+    void deallocate (T* p, size_t)
+    {
+        if (!_arena) ::operator delete (p);
+    }
+
+    JsonArena* arena () const { return _arena; }
+
+    template <class U>
+    bool operator== (const JsonAllocator<U>& a) const { return _arena == a.arena (); }
+    template <class U>
+    bool operator!= (const JsonAllocator<U>& a) const { return _arena != a.arena (); }
+
+private:
+    JsonArena* _arena;
+};
+
+#endif // ARENA_H
@@ -0,0 +1,27 @@
+#ifndef ATOD_H
+#define ATOD_H
+
+#include <cstddef>
+
+enum NumberKind
+{
+    NOT_A_NUMBER,
+    INTEGER_NUMBER,
+    FLOAT_NUMBER
+};
+
+///
+/// \brief parseNumber разбирает лексему size байт (без завершающего нуля)
+/// как число, не завися от текущей локали.
+///
+/// Числа по грамматике JSON разбираются за один проход: целое, которое
+/// помещается в long long, возвращается как INTEGER_NUMBER, остальные
+/// (дробная часть, порядок, переполнение long long) -- как FLOAT_NUMBER,
+/// округлённое до ближайшего double алгоритмом Эйселя-Лемира.
+/// Прочие лексемы ("+1", ".5", "0x10", "inf") по-прежнему понимаются
+/// так, как их понимают strtoll/strtod.
+/// \return вид числа; integer или number заполняется соответственно
+///
+NumberKind parseNumber (const char* s, size_t size, long long& integer, double& number);
+
+#endif // ATOD_H
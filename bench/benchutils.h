@@ -0,0 +1,159 @@
+#ifndef BENCHUTILS_H
+#define BENCHUTILS_H
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Небольшие общие помощники для бенчмарков:
+// таймер и генераторы типовых документов
+
+class BenchTimer
+{
+public:
+    BenchTimer() : _start(std::chrono::steady_clock::now()) {}
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - _start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start;
+};
+
+///
+/// \brief bench_run прогоняет f() iterations раз и печатает время
+/// и пропускную способность в МБ/с (если bytes != 0)
+///
+template<class F>
+double bench_run(const char* name, size_t iterations, size_t bytes, F f)
+{
+    f(); // прогрев
+    BenchTimer t;
+    for (size_t i = 0; i < iterations; ++i) f();
+    double s = t.seconds();
+    if (bytes)
+        printf("%-40s %10.3f ms/iter %10.1f MB/s\n", name,
+               s * 1000.0 / iterations,
+               (double)bytes * iterations / s / (1024.0 * 1024.0));
+    else
+        printf("%-40s %10.3f ms/iter\n", name, s * 1000.0 / iterations);
+    return s;
+}
+
+///
+/// \brief bench_heap_used сколько байт кучи сейчас занято (0, если неизвестно)
+///
+inline size_t bench_heap_used()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks + mallinfo2().hblkhd;
+#else
+    return 0;
+#endif
+}
+
+///
+/// \brief bench_records типичный документ: массив однотипных записей
+///
+inline std::string bench_records(size_t count)
+{
+    std::string js = "[";
+    char buf[256];
+    for (size_t i = 0; i < count; ++i)
+    {
+        snprintf(buf, sizeof(buf),
+                 "%s{\"id\":%zu,\"name\":\"user%zu\",\"score\":%zu.%02zu,"
+                 "\"active\":%s,\"tags\":[\"a\",\"b\",\"c\"],"
+                 "\"note\":\"line\\nwith \\\"escapes\\\"\"}",
+                 i ? "," : "", i, i, i % 1000, i % 100,
+                 (i & 1) ? "true" : "false");
+        js += buf;
+    }
+    js += "]";
+    return js;
+}
+
+///
+/// \brief bench_nested глубоко вложенный документ [[[...]]]
+///
+inline std::string bench_nested(size_t depth)
+{
+    std::string js;
+    for (size_t i = 0; i < depth; ++i) js += "[1,";
+    js += "0";
+    for (size_t i = 0; i < depth; ++i) js += "]";
+    return js;
+}
+
+///
+/// \brief bench_wide плоский объект с большим числом членов
+///
+inline std::string bench_wide(size_t count)
+{
+    std::string js = "{";
+    char buf[64];
+    for (size_t i = 0; i < count; ++i)
+    {
+        snprintf(buf, sizeof(buf), "%s\"k%zu\":[%zu]", i ? "," : "", i, i);
+        js += buf;
+    }
+    js += "}";
+    return js;
+}
+
+///
+/// \brief bench_telemetry документ телеметрии: записи, в которых
+/// большая часть значений -- double со всеми значащими цифрами
+///
+inline std::string bench_telemetry(size_t count)
+{
+    std::string js = "[";
+    char buf[512];
+    unsigned long long x = 88172645463325252ull;
+    for (size_t i = 0; i < count; ++i)
+    {
+        double d[7];
+        for (int k = 0; k < 7; ++k)
+        {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            d[k] = (double)(x >> 11) / 9007199254740992.0 * 1000.0 - 500.0;
+        }
+        snprintf(buf, sizeof(buf),
+                 "%s{\"ts\":%zu,\"lat\":%.17g,\"lon\":%.17g,\"alt\":%.17g,"
+                 "\"v\":[%.17g,%.17g,%.17g],\"t\":%.3f,\"ok\":true}",
+                 i ? "," : "", 1600000000 + i, d[0], d[1], d[2],
+                 d[3], d[4], d[5], d[6]);
+        js += buf;
+    }
+    js += "]";
+    return js;
+}
+
+///
+/// \brief bench_text записи с длинными текстовыми полями; escape-
+/// последовательность встречается в одной строке из escapeEvery
+///
+inline std::string bench_text(size_t count, size_t length, size_t escapeEvery)
+{
+    static const char words[] = "lorem ipsum dolor sit amet consectetur adipiscing elit ";
+    std::string js = "[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i) js += ",";
+        js += "{\"id\":" + std::to_string(i) + ",\"body\":\"";
+        for (size_t n = 0; n < length; ++n) js += words[(i + n) % (sizeof(words) - 1)];
+        if (escapeEvery && i % escapeEvery == 0) js += "\\n\\u00e9";
+        js += "\"}";
+    }
+    js += "]";
+    return js;
+}
+
+#endif // BENCHUTILS_H
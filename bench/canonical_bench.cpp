@@ -0,0 +1,85 @@
+#include "value.h"
+#include "stringutils.h"
+#include "benchutils.h"
+
+#include <algorithm>
+
+// Сериализация с упорядоченными ключами: прежняя схема (копия ключей
+// через indexes(), сортировка строк и повторный поиск каждого ключа)
+// против stringify(v, true) и canonicalStringify, которые сортируют
+// указатели на члены, а у больших объектов берут готовый порядок из кэша
+
+static void legacySorted(std::string& out, const JsonValue& v)
+{
+    if (v.isObject())
+    {
+        std::vector<std::string> keys = v.indexes();
+        std::sort(keys.begin(), keys.end());
+        out += '{';
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (i) out += ',';
+            out += '\"' + escapedString(keys[i]) + "\":";
+            legacySorted(out, v[keys[i]]);
+        }
+        out += '}';
+    }
+    else if (v.isArray())
+    {
+        out += '[';
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            if (i) out += ',';
+            legacySorted(out, v[i]);
+        }
+        out += ']';
+    }
+    else
+    {
+        out += stringify(v);
+    }
+}
+
+static void compare(const char* title, const std::string& js, size_t iterations)
+{
+    std::string buf = js;
+    JsonValue v = parse_buffer(&buf[0], buf.size());
+    size_t bytes = canonicalStringify(v).size();
+    printf("%s (%zu bytes)\n", title, bytes);
+
+    size_t total = 0;
+    bench_run("  indexes() + sort + lookup (legacy)", iterations, bytes, [&]()
+    {
+        std::string out;
+        legacySorted(out, v);
+        total += out.size();
+    });
+    bench_run("  stringify sorted", iterations, bytes, [&]()
+    {
+        total += stringify(v, true).size();
+    });
+    bench_run("  canonicalStringify", iterations, bytes, [&]()
+    {
+        total += canonicalStringify(v).size();
+    });
+    bench_run("  canonicalStringify, fresh copy", iterations, bytes, [&]()
+    {
+        // копия не наследует кэш порядка -- худший случай
+        JsonValue c(v);
+        total += canonicalStringify(c).size();
+    });
+    bench_run("  copy only", iterations, 0, [&]()
+    {
+        JsonValue c(v);
+        total += c.size();
+    });
+    printf("  (checksum %zu)\n", total);
+}
+
+int main()
+{
+    compare("records x 100000", bench_records(100000), 5);
+    compare("wide object x 100000", bench_wide(100000), 5);
+    compare("telemetry x 100000", bench_telemetry(100000), 5);
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include "value.h"
+#include "linkedmap.h"
+#include "benchutils.h"
+
+#include <unordered_set>
+#include <vector>
+
+// Контейнеры JsonValue: индексный доступ к большим массивам,
+// память и поиск в ObjectContainer в сравнении с прежним LinkedMap,
+// размер узла и расход памяти на элемент документа
+
+static void array_bench(size_t n)
+{
+    printf("array x %zu\n", n);
+    JsonValue a(JsonValue::Type::ARRAY);
+    ArrayContainer& ac = *a.asArray();
+    for (size_t i = 0; i < n; ++i) ac.emplace_back((long long)i);
+
+    long long sum = 0;
+    bench_run("  indexed loop a[i]", 5, 0, [&]()
+    {
+        for (size_t i = 0; i < n; ++i) sum += a[i].asInt();
+    });
+    bench_run("  at(i)", 5, 0, [&]()
+    {
+        for (size_t i = 0; i < n; ++i) sum += a.at(i).asInt();
+    });
+    bench_run("  range-for", 5, 0, [&]()
+    {
+        for (const auto& v : ac) sum += v.asInt();
+    });
+    bench_run("  insert/erase in the middle x 1000", 1, 0, [&]()
+    {
+        for (size_t i = 0; i < 1000; ++i) a.insert(n / 2, JsonValue(1));
+        for (size_t i = 0; i < 1000; ++i) a.erase(JsonValue((long long)(n / 2)));
+    });
+    bench_run("  build with add()", 1, 0, [&]()
+    {
+        JsonValue b(JsonValue::Type::ARRAY);
+        for (size_t i = 0; i < n; ++i) b.add(JsonValue((long long)i));
+    });
+    printf("  (checksum %lld)\n", sum);
+}
+
+template<class Map>
+static void map_bench(const char* title, const std::vector<std::string>& keys)
+{
+    printf("  %s\n", title);
+    size_t before = bench_heap_used();
+    Map* m = new Map;
+    for (size_t i = 0; i < keys.size(); ++i) (*m)[keys[i]] = JsonValue((long long)i);
+    size_t bytes = bench_heap_used() - before;
+    printf("    %-36s %10.1f bytes/member\n", "heap", (double)bytes / keys.size());
+
+    long long sum = 0;
+    bench_run("    lookup every key", 5, 0, [&]()
+    {
+        for (const auto& k : keys) sum += (*m)[k].asInt();
+    });
+    bench_run("    has_key miss", 5, 0, [&]()
+    {
+        for (const auto& k : keys) sum += m->has_key(k + "?");
+    });
+    // удаление вперемешку с поиском: ни find, ни size не должны
+    // обходить весь объект после каждого erase
+    bench_run("    erase half + find/size after each", 1, 0, [&]()
+    {
+        for (size_t i = 0; i + 1 < keys.size(); i += 2)
+        {
+            m->erase(keys[i]);
+            sum += m->find(keys[i + 1])->second.asInt() + (long long)m->size();
+        }
+    });
+    printf("    (checksum %lld)\n", sum);
+    delete m;
+}
+
+static void object_bench(size_t n)
+{
+    printf("object x %zu\n", n);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; ++i) keys.push_back("member_" + std::to_string(i));
+    map_bench<LinkedMap<std::string, JsonValue> >("LinkedMap", keys);
+    map_bench<ObjectContainer>("ObjectContainer", keys);
+}
+
+static void pointer_bench(size_t n)
+{
+    printf("pointer x %zu\n", n);
+    std::string js = bench_records(n);
+    JsonValue doc = parse_buffer(&js[0], js.size());
+    size_t total = 0;
+    bench_run("  getPointer() of every record's \"name\"", 1, 0, [&]()
+    {
+        for (size_t i = 0; i < n; ++i) total += doc[i]["name"].getPointer().size();
+    });
+    bench_run("  pos() after insert at the front", 1, 0, [&]()
+    {
+        doc.insert(0, JsonValue(0));
+        for (size_t i = 0; i < n; ++i) total += doc[i].pos();
+    });
+    printf("  (checksum %zu)\n", total);
+}
+
+static void equality_bench(size_t n)
+{
+    printf("equality x %zu records\n", n);
+    std::string js = bench_records(n);
+    JsonValue a = parse_buffer(&js[0], js.size());
+    JsonValue b = parse_buffer(&js[0], js.size());
+    size_t equal = 0;
+    bench_run("  operator== record by record", 5, 0, [&]()
+    {
+        for (size_t i = 0; i < n; ++i) equal += a[i] == b[i];
+    });
+    bench_run("  stringify-and-compare (old way)", 5, 0, [&]()
+    {
+        for (size_t i = 0; i < n; ++i) equal += stringify(a[i], true) == stringify(b[i], true);
+    });
+    bench_run("  dedupe into unordered_set", 1, 0, [&]()
+    {
+        std::unordered_set<JsonValue> seen;
+        for (size_t i = 0; i < n; ++i) seen.insert(a[i]);
+        for (size_t i = 0; i < n; ++i) equal += seen.count(b[i]);
+    });
+    printf("  (checksum %zu)\n", equal);
+}
+
+template<class F>
+static void per_element(const char* title, size_t n, F build)
+{
+    size_t before = bench_heap_used();
+    JsonValue* v = new JsonValue(build());
+    size_t bytes = bench_heap_used() - before;
+    printf("  %-38s %10.1f bytes/element\n", title, (double)bytes / n);
+    delete v;
+}
+
+static void memory_report()
+{
+#ifdef USE_COMPACT_VALUE_LAYOUT
+    printf("memory (compact layout), sizeof(JsonValue) = %zu\n", sizeof(JsonValue));
+#else
+    printf("memory (default layout), sizeof(JsonValue) = %zu\n", sizeof(JsonValue));
+#endif
+    const size_t n = 1000000;
+    per_element("array of integers x 1000000", n, [&]()
+    {
+        JsonValue a(JsonValue::Type::ARRAY);
+        ArrayContainer& ac = *a.asArray();
+        for (size_t i = 0; i < n; ++i) ac.emplace_back((long long)i);
+        return a;
+    });
+    per_element("array of doubles x 1000000", n, [&]()
+    {
+        JsonValue a(JsonValue::Type::ARRAY);
+        ArrayContainer& ac = *a.asArray();
+        for (size_t i = 0; i < n; ++i) ac.emplace_back(i * 0.5);
+        return a;
+    });
+    per_element("array of short strings x 1000000", n, [&]()
+    {
+        JsonValue a(JsonValue::Type::ARRAY);
+        ArrayContainer& ac = *a.asArray();
+        for (size_t i = 0; i < n; ++i) ac.emplace_back(std::to_string(i % 10000));
+        return a;
+    });
+    std::string records = bench_records(100000);
+    per_element("parsed records x 100000 (per record)", 100000, [&]()
+    {
+        return parse_buffer(&records[0], records.size());
+    });
+}
+
+int main()
+{
+    memory_report();
+    array_bench(10000);
+    array_bench(100000);
+    array_bench(1000000);
+    object_bench(16);
+    object_bench(1000);
+    object_bench(100000);
+    pointer_bench(100000);
+    equality_bench(100000);
+    return 0;
+}
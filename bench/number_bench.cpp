@@ -0,0 +1,154 @@
+#include "value.h"
+#include "atod.h"
+#include "stringutils.h"
+#include "benchutils.h"
+
+#include <cfloat>
+#include <cstdlib>
+#include <vector>
+
+// Печать double: прежний вариант через snprintf против formatNumber
+// (кратчайшее представление); разбор чисел: прежний strtoll + strtod
+// против parseNumber; а также разбор и сериализация документа,
+// в котором большинство значений -- числа с плавающей точкой
+
+// прежний разбор лексемы в конструкторе JsonValue
+static int legacyParse(const std::string& token, long long& l, double& d)
+{
+    char* p = 0;
+    if (l = strtoll(token.c_str(), &p, 10), *p == 0) return INTEGER_NUMBER;
+    if (d = strtod(token.c_str(), &p), *p == 0) return FLOAT_NUMBER;
+    return NOT_A_NUMBER;
+}
+
+static size_t legacyFormat(char* buf, double d)
+{
+    int buffer_size = 64;
+    int printedChars = 0;
+
+    double absd = d < 0 ? -d: d;
+    double delta = (int64_t)(d) - d;
+    double absDelta = delta < 0 ? -delta : delta;
+    if ((d * 0) != 0) {
+        printedChars = snprintf(buf, buffer_size, "null");
+    } else if ((absDelta <= DBL_EPSILON) && (absd < 1.0e60)) {
+        printedChars = snprintf(buf, buffer_size, "%.1f", d);
+    } else if ((absd < 1.0e-6) || (absd > 1.0e9)) {
+        printedChars = snprintf(buf, buffer_size, "%e", d);
+    } else {
+        printedChars = snprintf(buf, buffer_size, "%f", d);
+        if (printedChars < buffer_size) {
+            while (buf[printedChars - 1] == '0') {
+                printedChars--;
+            }
+        }
+    }
+    return (size_t)printedChars;
+}
+
+template<class F>
+static void format_run(const char* name, const std::vector<double>& values, F format)
+{
+    char buf[64];
+    size_t total = 0;
+    size_t lost = 0;
+    bench_run(name, 5, 0, [&]()
+    {
+        for (double d : values) total += format(buf, d);
+    });
+    for (double d : values)
+    {
+        buf[format(buf, d)] = 0;
+        if (strtod(buf, 0) != d) ++lost;
+    }
+    printf("  %zu of %zu values do not round-trip (checksum %zu)\n",
+           lost, values.size(), total);
+}
+
+int main()
+{
+    std::vector<double> values;
+    unsigned long long x = 2463534242ull;
+    for (size_t i = 0; i < 1000000; ++i)
+    {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        switch (i % 4)
+        {
+        case 0: values.push_back((double)(x % 100000) / 100.0); break;
+        case 1: values.push_back((double)(x >> 11) / 9007199254740992.0); break;
+        case 2: values.push_back((double)(long long)(x % 1000000)); break;
+        default:
+        {
+            double d;
+            memcpy(&d, &x, sizeof(d));
+            values.push_back(d * 0 == 0 ? d : 1.0);
+        }
+        }
+    }
+
+    printf("format 1000000 doubles\n");
+    format_run("  snprintf (legacy)", values, legacyFormat);
+    format_run("  formatNumber", values, [](char* buf, double d)
+    {
+        return formatNumber(buf, d);
+    });
+
+    std::vector<std::string> tokens;
+    size_t tokenBytes = 0;
+    char buf[64];
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        // половина чисел -- целые, как в типичных документах
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        if (i % 2) snprintf(buf, sizeof(buf), "%lld", (long long)(x >> (x % 64)));
+        else buf[formatNumber(buf, values[i])] = 0;
+        tokens.push_back(buf);
+        tokenBytes += tokens.back().size();
+    }
+    printf("parse %zu number tokens\n", tokens.size());
+    size_t mismatches = 0;
+    for (const std::string& t : tokens)
+    {
+        long long l1 = 0, l2 = 0;
+        double d1 = 0, d2 = 0;
+        int k1 = legacyParse(t, l1, d1);
+        int k2 = parseNumber(t.data(), t.size(), l2, d2);
+        if (k1 != k2 || (k1 == INTEGER_NUMBER && l1 != l2) ||
+            (k1 == FLOAT_NUMBER && memcmp(&d1, &d2, sizeof(d1)) != 0))
+            ++mismatches;
+    }
+    double sum = 0;
+    bench_run("  strtoll + strtod (legacy)", 5, tokenBytes, [&]()
+    {
+        long long l = 0;
+        double d = 0;
+        for (const std::string& t : tokens)
+            sum += legacyParse(t, l, d) == INTEGER_NUMBER ? (double)l : d;
+    });
+    bench_run("  parseNumber", 5, tokenBytes, [&]()
+    {
+        long long l = 0;
+        double d = 0;
+        for (const std::string& t : tokens)
+            sum += parseNumber(t.data(), t.size(), l, d) == INTEGER_NUMBER ? (double)l : d;
+    });
+    printf("  %zu mismatches (checksum %g)\n", mismatches, sum);
+
+    std::string js = bench_telemetry(200000);
+    JsonValue v = parse_buffer(&js[0], js.size());
+    size_t bytes = stringify(v).size();
+    printf("telemetry x 200000 (%zu bytes)\n", bytes);
+    bench_run("  parse", 5, js.size(), [&]()
+    {
+        JsonValue parsed = parse(js.data(), js.size());
+    });
+    size_t total = 0;
+    bench_run("  stringify", 5, bytes, [&]()
+    {
+        total += stringify(v).size();
+    });
+    std::string out = stringify(v);
+    printf("  round-trip: %s (checksum %zu)\n",
+           parse_buffer(&out[0], out.size()) == v ? "exact" : "differs", total);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "value.h"
+#include "benchutils.h"
+
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+
+// Сравнение однопроходного parse_buffer с прежним разбором через jsmn;
+// parse и parse_string читают входной буфер без копирования.
+// Серия nested показывает рост времени с глубиной вложенности:
+// у parse_buffer он линейный
+
+static void compare(const char* title, const std::string& js, size_t iterations)
+{
+    printf("%s (%zu bytes)\n", title, js.size());
+    std::string buf = js;
+    bench_run("  parse_buffer", iterations, js.size(), [&]()
+    {
+        JsonValue v = parse_buffer(&buf[0], buf.size());
+    });
+    bench_run("  parse (const buffer)", iterations, js.size(), [&]()
+    {
+        JsonValue v = parse(js.data(), js.size());
+    });
+    bench_run("  parse_string", iterations, js.size(), [&]()
+    {
+        JsonValue v = parse_string(js.c_str());
+    });
+    bench_run("  parse_buffer_jsmn", iterations, js.size(), [&]()
+    {
+        JsonValue v = parse_buffer_jsmn(&buf[0], buf.size());
+    });
+}
+
+// Разбор и разрушение документа: узлы в куче против узлов в арене.
+// Арена переиспользуется между итерациями через release()
+static void arena_compare(const char* title, const std::string& js, size_t iterations)
+{
+    printf("%s (%zu bytes)\n", title, js.size());
+    std::string buf = js;
+    bench_run("  heap: parse + destroy", iterations, js.size(), [&]()
+    {
+        JsonValue v = parse_buffer(&buf[0], buf.size());
+    });
+    JsonArena arena;
+    bench_run("  arena: parse + destroy + release", iterations, js.size(), [&]()
+    {
+        {
+            JsonValue v = parse_buffer(&buf[0], buf.size(), &arena);
+        }
+        arena.release();
+    });
+}
+
+// Поток небольших сообщений: свежий контекст разбора на каждое
+// (служебная память выделяется и освобождается каждый раз) против
+// контекста потока, который её сохраняет
+static void messages_compare(const char* title, size_t count, size_t iterations)
+{
+    std::vector<std::string> messages;
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        messages.push_back(bench_records(1 + i % 3));
+        bytes += messages.back().size();
+    }
+    printf("%s (%zu bytes)\n", title, bytes);
+    bench_run("  parse, new JsonParser per message", iterations, bytes, [&]()
+    {
+        for (const std::string& m : messages)
+        {
+            JsonParser parser;
+            JsonValue v = parser.parse(m.data(), m.size());
+        }
+    });
+    bench_run("  parse (thread context)", iterations, bytes, [&]()
+    {
+        for (const std::string& m : messages)
+            JsonValue v = parse(m.data(), m.size());
+    });
+    bench_run("  parseJsmn, new JsonParser per message", iterations, bytes, [&]()
+    {
+        for (const std::string& m : messages)
+        {
+            JsonParser parser;
+            JsonValue v = parser.parseJsmn(m.data(), m.size());
+        }
+    });
+    bench_run("  parse_buffer_jsmn (thread context)", iterations, bytes, [&]()
+    {
+        for (const std::string& m : messages)
+            JsonValue v = parse_buffer_jsmn(m.data(), m.size());
+    });
+}
+
+// Разбор файла: прежний способ (malloc на весь файл + fread + parse_buffer)
+// против parse_file, который разбирает прямо из mmap
+static void file_compare(const char* title, const std::string& js, size_t iterations)
+{
+    char name[] = "/tmp/parse_bench_XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0) return;
+    FILE* f = fdopen(fd, "wb");
+    fwrite(js.data(), 1, js.size(), f);
+    fclose(f);
+
+    printf("%s (%zu bytes)\n", title, js.size());
+    bench_run("  malloc + fread + parse_buffer", iterations, js.size(), [&]()
+    {
+        FILE* in = fopen(name, "rb");
+        char* buf = (char*)malloc(js.size());
+        size_t n = fread(buf, 1, js.size(), in);
+        fclose(in);
+        JsonValue v = parse_buffer(buf, n);
+        free(buf);
+    });
+    bench_run("  parse_file (mmap)", iterations, js.size(), [&]()
+    {
+        JsonValue v = parse_file(name);
+    });
+    unlink(name);
+}
+
+int main()
+{
+    compare("records x 100000", bench_records(100000), 5);
+    compare("wide object x 100000", bench_wide(100000), 5);
+    for (size_t depth = 1000; depth <= 8000; depth *= 2)
+    {
+        std::string title = "nested x " + std::to_string(depth);
+        compare(title.c_str(), bench_nested(depth), 5);
+    }
+
+    arena_compare("arena: records x 100000", bench_records(100000), 5);
+    arena_compare("arena: wide object x 100000", bench_wide(100000), 5);
+
+    messages_compare("messages x 200000", 200000, 5);
+
+    file_compare("file: records x 400000", bench_records(400000), 5);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "value.h"
+#include "benchutils.h"
+
+// Сериализация больших документов: stringify/prettyStringify в строку
+// и в приёмники JsonSink, подсчёт длины serializedSize, повторная
+// сериализация с кэшем memoStringify
+
+static void serialize(const char* title, const std::string& js, size_t iterations)
+{
+    std::string buf = js;
+    JsonValue v = parse_buffer(&buf[0], buf.size());
+    size_t bytes = stringify(v).size();
+    printf("%s (%zu bytes)\n", title, bytes);
+
+    size_t total = 0;
+    bench_run("  stringify", iterations, bytes, [&]()
+    {
+        total += stringify(v).size();
+    });
+    bench_run("  stringify sorted", iterations, bytes, [&]()
+    {
+        total += stringify(v, true).size();
+    });
+    bench_run("  prettyStringify", iterations, prettyStringify(v).size(), [&]()
+    {
+        total += prettyStringify(v).size();
+    });
+    bench_run("  parallelStringify", iterations, bytes, [&]()
+    {
+        total += parallelStringify(v).size();
+    });
+    bench_run("  parallelStringify sorted", iterations, bytes, [&]()
+    {
+        total += parallelStringify(v, true).size();
+    });
+    bench_run("  serializedSize", iterations, bytes, [&]()
+    {
+        total += v.serializedSize();
+    });
+    bench_run("  stringify with exact preallocation", iterations, bytes, [&]()
+    {
+        std::string res;
+        JsonStringSink out(res, v.serializedSize());
+        stringify(out, v);
+        out.flush();
+        total += res.size();
+    });
+    memoStringify(v);
+    bench_run("  memoStringify, nothing changed", iterations, bytes, [&]()
+    {
+        total += memoStringify(v).size();
+    });
+    size_t n = 0;
+    bench_run("  memoStringify, one leaf changed", iterations, bytes, [&]()
+    {
+        size_t i = n++ % v.size();
+        JsonValue& child = v.isArray() ? v[i] : v[v.at(i).key().asString()];
+        child = JsonValue(child);
+        total += memoStringify(v).size();
+    });
+    std::string reused;
+    bench_run("  stringify into a reused string", iterations, bytes, [&]()
+    {
+        reused.clear();
+        JsonStringSink out(reused);
+        stringify(out, v);
+        out.flush();
+        total += reused.size();
+    });
+    FILE* devnull = fopen("/dev/null", "w");
+    if (devnull)
+    {
+        bench_run("  stringify to FILE* /dev/null", iterations, bytes, [&]()
+        {
+            JsonFileSink out(devnull);
+            stringify(out, v);
+        });
+        fclose(devnull);
+    }
+    printf("  (checksum %zu)\n", total);
+}
+
+int main()
+{
+    serialize("records x 400000", bench_records(400000), 3);
+    serialize("wide object x 100000", bench_wide(100000), 5);
+    serialize("nested x 2000", bench_nested(2000), 5);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "value.h"
+#include "streamwriter.h"
+#include "benchutils.h"
+
+// Выгрузка большого документа: сначала дерево, потом stringify --
+// против JsonStreamWriter, который пишет записи в приёмник по мере
+// их появления, не держа документ в памяти. И переформатирование
+// текста: parse + stringify против minify/reformat без дерева
+
+static const char* const tags[] = { "a", "b", "c" };
+
+static void record(JsonValue& r, size_t i)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "user%zu", i);
+    r["id"] = (long long)i;
+    r["name"] = name;
+    r["score"] = (double)(i % 1000) + (double)(i % 100) / 100;
+    r["active"] = (i & 1) != 0;
+    JsonValue& t = r["tags"];
+    for (const char* tag : tags) t.add(JsonValue(tag));
+    r["note"] = "line\nwith \"escapes\"";
+}
+
+static void record(JsonStreamWriter& w, size_t i)
+{
+    char name[32];
+    size_t n = (size_t)snprintf(name, sizeof(name), "user%zu", i);
+    w.beginObject();
+    w.key("id");
+    w.value(JsonValue((long long)i));
+    w.key("name");
+    w.value(name, n);
+    w.key("score");
+    w.value(JsonValue((double)(i % 1000) + (double)(i % 100) / 100));
+    w.key("active");
+    w.value(JsonValue((i & 1) != 0));
+    w.key("tags");
+    w.beginArray();
+    for (const char* tag : tags) w.value(tag, 1);
+    w.endArray();
+    w.key("note");
+    w.value("line\nwith \"escapes\"", 19);
+    w.endObject();
+}
+
+int main()
+{
+    const size_t count = 1000000;
+
+    std::string dom;
+    size_t heapBefore = bench_heap_used();
+    size_t heapPeak = 0;
+    {
+        JsonValue doc(JsonValue::ARRAY);
+        for (size_t i = 0; i < count; ++i) record(doc[i], i);
+        heapPeak = bench_heap_used();
+        dom = stringify(doc);
+    }
+    std::string streamed;
+    {
+        JsonStringSink out(streamed);
+        JsonStreamWriter w(out);
+        w.beginArray();
+        for (size_t i = 0; i < count; ++i) record(w, i);
+        w.endArray();
+    }
+    printf("records x %zu (%zu bytes), identical output: %s\n", count,
+           dom.size(), dom == streamed ? "yes" : "NO");
+    if (heapPeak > heapBefore)
+        printf("  DOM for the export holds %.1f MB of heap\n",
+               (double)(heapPeak - heapBefore) / (1024.0 * 1024.0));
+
+    FILE* devnull = fopen("/dev/null", "w");
+    if (devnull == 0) return 1;
+    size_t bytes = dom.size();
+    bench_run("  build DOM + stringify to FILE*", 3, bytes, [&]()
+    {
+        JsonValue doc(JsonValue::ARRAY);
+        for (size_t i = 0; i < count; ++i) record(doc[i], i);
+        JsonFileSink out(devnull);
+        stringify(out, doc);
+    });
+    bench_run("  JsonStreamWriter to FILE*", 3, bytes, [&]()
+    {
+        JsonFileSink out(devnull);
+        JsonStreamWriter w(out);
+        w.beginArray();
+        for (size_t i = 0; i < count; ++i) record(w, i);
+        w.endArray();
+    });
+    fclose(devnull);
+
+    std::string compact = bench_telemetry(200000);
+    std::string pretty;
+    {
+        std::string buf = compact;
+        pretty = prettyStringify(parse_buffer(&buf[0], buf.size()));
+    }
+    printf("telemetry: %zu bytes compact, %zu bytes pretty\n",
+           compact.size(), pretty.size());
+
+    std::string res;
+    bench_run("  memcpy of the pretty text", 5, pretty.size(), [&]()
+    {
+        res.assign(pretty);
+    });
+    bench_run("  parse_buffer + stringify", 5, pretty.size(), [&]()
+    {
+        std::string buf = pretty;
+        res = stringify(parse_buffer(&buf[0], buf.size()));
+    });
+    bench_run("  minify", 5, pretty.size(), [&]()
+    {
+        res.clear();
+        JsonStringSink out(res);
+        minify(out, pretty.data(), pretty.size());
+    });
+    bench_run("  parse_buffer + prettyStringify", 5, compact.size(), [&]()
+    {
+        std::string buf = compact;
+        res = prettyStringify(parse_buffer(&buf[0], buf.size()));
+    });
+    bench_run("  reformat", 5, compact.size(), [&]()
+    {
+        res.clear();
+        JsonStringSink out(res);
+        reformat(out, compact.data(), compact.size());
+    });
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "value.h"
+#include "scan.h"
+#include "stringutils.h"
+#include "benchutils.h"
+#include "3rdparty/utf8/utf8.h"
+
+// Экранирование и раскодирование строк: прежние побайтовые циклы против
+// escape()/unescape(), которые ищут особые байты векторно и копируют
+// чистые участки целиком. Затем stringify и parse_buffer документа
+// с длинными текстовыми полями
+
+static void legacyEscape(JsonSink& out, const char* src, size_t size)
+{
+    const char* end = src + size;
+    const char* run = src;
+    for (; src != end && *src; ++src)
+    {
+        char e;
+        switch (*src)
+        {
+        case '\"' : e = '\"'; break;
+        case '\\' : e = '\\'; break;
+        case '/'  : e = '/'; break;
+        case '\b' : e = 'b'; break;
+        case '\f' : e = 'f'; break;
+        case '\n' : e = 'n'; break;
+        case '\r' : e = 'r'; break;
+        case '\t' : e = 't'; break;
+        default:
+            continue;
+        }
+        out.write(run, (size_t)(src - run));
+        out.put('\\');
+        out.put(e);
+        run = src + 1;
+    }
+    out.write(run, (size_t)(src - run));
+}
+
+int main()
+{
+    printf("scan kernel: %s\n", scanKernel());
+
+    // 1 МБ текста с редкими escape-последовательностями
+    std::string text;
+    while (text.size() < (1 << 20))
+    {
+        text += "The quick brown fox jumps over the lazy dog; ";
+        if (text.size() % 4096 < 48) text += "\\\"quoted\\\"\\n";
+    }
+    std::string raw(text.size() + 1, 0);
+    raw.resize(unescape(&raw[0], text.c_str(), text.size()));
+
+    std::string out;
+    printf("escape 1 MB of text\n");
+    bench_run("  byte loop (legacy)", 200, raw.size(), [&]()
+    {
+        out.clear();
+        JsonStringSink sink(out);
+        legacyEscape(sink, raw.data(), raw.size());
+    });
+    bench_run("  escape", 200, raw.size(), [&]()
+    {
+        out.clear();
+        JsonStringSink sink(out);
+        escape(sink, raw.data(), raw.size());
+    });
+
+    std::vector<char> buf(text.size() + 1);
+    printf("unescape 1 MB of text\n");
+    bench_run("  u8_unescape (legacy)", 200, text.size(), [&]()
+    {
+        u8_unescape(&buf[0], buf.size(), text.c_str());
+    });
+    bench_run("  unescape", 200, text.size(), [&]()
+    {
+        unescape(&buf[0], text.c_str(), text.size());
+    });
+
+    std::string js = bench_text(20000, 2000, 16);
+    std::string parsed = js;
+    JsonValue v = parse_buffer(&parsed[0], parsed.size());
+    size_t bytes = stringify(v).size();
+    printf("text records x 20000 (%zu bytes)\n", bytes);
+    bench_run("  stringify", 10, bytes, [&]()
+    {
+        out = stringify(v);
+    });
+    bench_run("  parse_buffer", 10, js.size(), [&]()
+    {
+        parsed = js;
+        JsonValue p = parse_buffer(&parsed[0], parsed.size());
+    });
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "value.h"
+#include "benchutils.h"
+
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Параллельная сериализация: каждый поток сериализует свой документ
+// в свою строку. Общего состояния у stringify нет, поэтому суммарная
+// пропускная способность должна расти пропорционально числу потоков
+
+static double run_threads(std::vector<JsonValue>& docs, size_t threads,
+                          size_t iterations, size_t& total)
+{
+    std::vector<size_t> sizes(threads, 0);
+    std::vector<std::thread> pool;
+    BenchTimer t;
+    for (size_t n = 0; n < threads; ++n)
+    {
+        pool.emplace_back([&docs, &sizes, n, iterations]()
+        {
+            std::string out;
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                out.clear();
+                JsonStringSink sink(out);
+                stringify(sink, docs[n]);
+                sink.flush();
+                sizes[n] += out.size();
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+    double s = t.seconds();
+    for (size_t n : sizes) total += n;
+    return s;
+}
+
+int main(int argc, char** argv)
+{
+    // число потоков можно задать аргументом, по умолчанию -- все ядра
+    size_t cores = argc > 1 ? strtoul(argv[1], 0, 10)
+                            : std::thread::hardware_concurrency();
+    if (cores == 0) cores = 1;
+
+    std::string js = bench_records(100000);
+    std::vector<JsonValue> docs;
+    for (size_t n = 0; n < cores; ++n)
+    {
+        std::string buf = js;
+        docs.push_back(parse_buffer(&buf[0], buf.size()));
+    }
+    size_t bytes = stringify(docs[0]).size();
+    printf("records x 100000 (%zu bytes), up to %zu threads\n", bytes, cores);
+
+    const size_t iterations = 10;
+    size_t total = 0;
+    double single = 0;
+    std::vector<size_t> counts;
+    for (size_t threads = 1; threads < cores; threads *= 2) counts.push_back(threads);
+    counts.push_back(cores);
+
+    for (size_t threads : counts)
+    {
+        double s = run_threads(docs, threads, iterations, total);
+        double mbs = (double)bytes * iterations * threads / s / (1024.0 * 1024.0);
+        if (threads == 1) single = mbs;
+        printf("  %3zu threads %10.1f MB/s  x%.2f\n", threads, mbs, mbs / single);
+    }
+    printf("  (checksum %zu)\n", total);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "value.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Документ больше 4 ГБ: значения после пробельного заполнителя лежат
+// за границей 2^32 байт, так что 32-битные смещения в разборщиках
+// (токены jsmn, позиции u8_unescape) на нём ломаются.
+// Файл создаётся в $TMPDIR (по умолчанию /tmp) и удаляется в конце
+
+static const size_t PADDING = (size_t)4400 << 20;
+
+static const char* const HEAD = "[\"head\",";
+static const char* const TAIL =
+    "\"tail\\u00e9\", 12345678901234567890, -2.5e-3, {\"k\\n\":[true,null]}]";
+static const char* const EXPECTED =
+    "[\"head\",\"tail\xc3\xa9\",1.2345678901234567e+19,-0.0025,{\"k\\n\":[true,null]}]";
+
+static bool write_document(const std::string& name)
+{
+    FILE* f = fopen(name.c_str(), "wb");
+    if (f == 0) return false;
+
+    static char spaces[1 << 20];
+    memset(spaces, ' ', sizeof(spaces));
+    bool ok = fputs(HEAD, f) >= 0;
+    for (size_t n = 0; ok && n < PADDING; n += sizeof(spaces))
+    {
+        ok = fwrite(spaces, 1, sizeof(spaces), f) == sizeof(spaces);
+    }
+    ok = ok && fputs(TAIL, f) >= 0;
+    return fclose(f) == 0 && ok;
+}
+
+static int check(const char* title, const JsonValue& v)
+{
+    std::string s = stringify(v);
+    if (s == EXPECTED)
+    {
+        printf("  %s: ok\n", title);
+        return 0;
+    }
+    printf("  %s: FAILED\n    got      %s\n    expected %s\n",
+           title, s.c_str(), EXPECTED);
+    return 1;
+}
+
+int main()
+{
+    const char* dir = getenv("TMPDIR");
+    std::string name = std::string(dir && *dir ? dir : "/tmp") +
+                       "/jsonvalue_huge_document.json";
+
+    if (!write_document(name))
+    {
+        printf("cannot write %s\n", name.c_str());
+        unlink(name.c_str());
+        return 1;
+    }
+
+    int fails = 0;
+    fails += check("parse_file", parse_file(name.c_str()));
+
+    int fd = open(name.c_str(), O_RDONLY);
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0)
+    {
+        p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (p == MAP_FAILED)
+    {
+        printf("cannot map %s\n", name.c_str());
+        ++fails;
+    }
+    else
+    {
+        printf("%zu bytes\n", (size_t)st.st_size);
+        fails += check("parse (const buffer)", parse((const char*)p, (size_t)st.st_size));
+        fails += check("parse_buffer_jsmn", parse_buffer_jsmn((const char*)p, (size_t)st.st_size));
+        munmap(p, (size_t)st.st_size);
+    }
+    if (fd >= 0) close(fd);
+    unlink(name.c_str());
+
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#include "builder.h"
+
+JsonBuilder::JsonBuilder(JsonValue& target, JsonArena* arena)
+    : _target(target), _arena(arena), _stack(_own.stack), _key(_own.key),
+      _hasKey(false), _hasRoot(false)
+{
+}
+
+JsonBuilder::JsonBuilder(JsonValue& target, JsonArena* arena, Storage& storage)
+    : _target(target), _arena(arena), _stack(storage.stack), _key(storage.key),
+      _hasKey(false), _hasRoot(false)
+{
+    // стек мог остаться от документа, разбор которого прервался
+    _stack.clear();
+}
+
+JsonArena* JsonBuilder::arenaFor(const JsonValue* v) const
+{
+    // вложенные узлы живут там же, где контейнер-владелец
+    if (v == &_target && _arena) return _arena;
+    return v->storageArena();
+}
+
+JsonValue* JsonBuilder::slot()
+{
+    if (_stack.empty())
+    {
+        if (_hasRoot) return 0;
+        _hasRoot = true;
+        // target может быть узлом чужого документа: кэш предков устарел
+        _target.dropMemo();
+        _target.reset();
+        return &_target;
+    }
+
+    JsonValue* owner = _stack.back();
+    JsonValue* rv = 0;
+    if (owner->type() == JsonValue::ARRAY)
+    {
+        ArrayContainer& ac = *owner->_value._a;
+        ac.emplace_back();
+        rv = &ac.back();
+        rv->setSlot(ac.size() - 1);
+    }
+    else
+    {
+        if (!_hasKey) return 0;
+        _hasKey = false;
+        // повторный ключ перезаписывает прежнее значение
+        ObjectContainer& oc = *owner->_value._o;
+        size_t n = oc.size();
+        rv = &oc[_key];
+        if (oc.size() != n) rv->setSlot(n);
+        rv->reset();
+    }
+    rv->setParent(owner);
+    return rv;
+}
+
+bool JsonBuilder::begin(JsonValue::Type type)
+{
+    JsonValue* v = slot();
+    if (v == 0) return false;
+
+    v->setContainer(type, arenaFor(v));
+    _stack.push_back(v);
+    return true;
+}
+
+bool JsonBuilder::end(JsonValue::Type type)
+{
+    if (_stack.empty() || _stack.back()->type() != type || _hasKey)
+        return false;
+    _stack.pop_back();
+    return true;
+}
+
+bool JsonBuilder::beginArray()
+{
+    return begin(JsonValue::ARRAY);
+}
+
+bool JsonBuilder::beginObject()
+{
+    return begin(JsonValue::OBJECT);
+}
+
+bool JsonBuilder::endArray()
+{
+    return end(JsonValue::ARRAY);
+}
+
+bool JsonBuilder::endObject()
+{
+    return end(JsonValue::OBJECT);
+}
+
+bool JsonBuilder::key(const std::string& k)
+{
+    return key(k.data(), k.size());
+}
+
+bool JsonBuilder::key(const char* k, size_t size)
+{
+    if (!inObject() || _hasKey) return false;
+    _key.assign(k, size);
+    _hasKey = true;
+    return true;
+}
+
+bool JsonBuilder::value(const JsonValue& v)
+{
+    JsonValue* rv = slot();
+    if (rv == 0) return false;
+    *rv = v;
+    return true;
+}
+
+bool JsonBuilder::value(JsonValue&& v)
+{
+    JsonValue* rv = slot();
+    if (rv == 0) return false;
+    *rv = std::move(v);
+    return true;
+}
+
+bool JsonBuilder::token(const char* buffer, size_t size, bool itIsString)
+{
+    JsonValue* rv = slot();
+    if (rv == 0) return false;
+    rv->setToken(buffer, size, itIsString, arenaFor(rv));
+    return true;
+}
+
+size_t JsonBuilder::depth() const
+{
+    return _stack.size();
+}
+
+bool JsonBuilder::inArray() const
+{
+    return !_stack.empty() && _stack.back()->type() == JsonValue::ARRAY;
+}
+
+bool JsonBuilder::inObject() const
+{
+    return !_stack.empty() && _stack.back()->type() == JsonValue::OBJECT;
+}
+
+bool JsonBuilder::done() const
+{
+    return _hasRoot && _stack.empty();
+}
@@ -0,0 +1,93 @@
+#ifndef BUILDER_H
+#define BUILDER_H
+
+#include "value.h"
+
+#include <string>
+#include <vector>
+
+///
+/// \brief JsonBuilder строит дерево JsonValue по событиям
+/// (beginObject/key/value/endObject ...).
+///
+/// Каждый узел создаётся сразу в своей окончательной ячейке
+/// контейнера-владельца, и _parent у него выставляется ровно один раз.
+/// Поэтому, в отличие от сборки "значение вернули - значение переложили",
+/// стоимость построения линейна по числу узлов при любой глубине.
+///
+/// Все методы возвращают false при нарушении порядка вызовов
+/// (например, value внутри объекта без предшествующего key).
+///
+class JsonBuilder
+{
+public:
+    ///
+    /// \brief Storage рабочая память построителя: стек открытых
+    /// контейнеров и буфер ключа. Переданная в конструктор, она переживает
+    /// построитель и достаётся следующему документу уже выделенной
+    ///
+    struct Storage
+    {
+        std::vector<JsonValue*> stack;
+        std::string key;
+    };
+
+    /// строит документ прямо в target (прежнее значение теряется);
+    /// с arena контейнеры и строки документа размещаются в арене
+    explicit JsonBuilder(JsonValue& target, JsonArena* arena = 0);
+    /// то же, но с рабочей памятью из storage
+    JsonBuilder(JsonValue& target, JsonArena* arena, Storage& storage);
+
+    bool beginArray();
+    bool beginObject();
+    bool endArray();
+    bool endObject();
+
+    bool key(const std::string& k);
+    bool key(const char* k, size_t size);
+
+    bool value(const JsonValue& v);
+    bool value(JsonValue&& v);
+
+    ///
+    /// \brief token записывает в следующую ячейку лексему из буфера
+    /// разбора: строку (itIsString) или примитив, как это делает
+    /// конструктор JsonValue(const char*, size_t, bool), но без промежуточного
+    /// значения и с учётом арены
+    ///
+    bool token(const char* buffer, size_t size, bool itIsString);
+
+    ///
+    /// \brief slot отдаёт следующую ячейку текущего контейнера
+    /// (или сам target, если контейнеров ещё нет), уже привязанную
+    /// к владельцу. Позволяет заполнить значение на месте.
+    /// \return 0, если ячейку взять нельзя
+    ///
+    JsonValue* slot();
+
+    /// глубина вложенности открытых контейнеров
+    size_t depth() const;
+    bool inArray() const;
+    bool inObject() const;
+
+    /// документ построен полностью: корень задан и все контейнеры закрыты
+    bool done() const;
+
+private:
+    JsonBuilder(const JsonBuilder&) = delete;
+    JsonBuilder& operator=(const JsonBuilder&) = delete;
+
+    bool begin(JsonValue::Type type);
+    bool end(JsonValue::Type type);
+    JsonArena* arenaFor(const JsonValue* v) const;
+
+    JsonValue& _target;
+    JsonArena* _arena;
+    Storage _own;
+    std::vector<JsonValue*>& _stack;
+    std::string& _key;
+    bool _hasKey;
+    bool _hasRoot;
+};
+
+#endif // BUILDER_H
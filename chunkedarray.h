@@ -0,0 +1,401 @@
+#ifndef CHUNKEDARRAY_H
+#define CHUNKEDARRAY_H
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+///
+/// ChunkedArray -- последовательность с произвольным доступом за O(1)
+/// и стабильными адресами элементов.
+///
+/// Сами элементы живут в блоках (одно выделение памяти на блок,
+/// блоки растут геометрически), а порядок задаётся вектором указателей.
+/// Поэтому:
+///  - operator[], итераторы с произвольным доступом -- O(1);
+///  - push_back/emplace_back -- амортизированно O(1);
+///  - insert/erase в середине сдвигают только указатели;
+///  - адрес элемента не меняется, пока элемент не удалён;
+///  - erase_deferred + compact удаляют много элементов за один сдвиг.
+/// Память удалённых элементов переиспользуется через список свободных ячеек.
+/// Блоки и вектор указателей берутся из аллокатора Alloc.
+///
+template <class T, class Alloc = std::allocator<T> >
+class ChunkedArray
+{
+    typedef std::allocator_traits<Alloc> alloc_traits;
+    typedef typename alloc_traits::template rebind_alloc<T*> index_alloc;
+    typedef std::pair<T*, size_t> chunk_type;
+    typedef typename alloc_traits::template rebind_alloc<chunk_type> chunk_alloc;
+    typedef std::vector<T*, index_alloc> index_type;
+
+public:
+    typedef T value_type;
+    typedef Alloc allocator_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+
+    template <class V, class BaseIt>
+    class basic_iterator
+    {
+        BaseIt _it;
+
+        template <class, class> friend class basic_iterator;
+        friend class ChunkedArray;
+
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        basic_iterator () : _it () {}
+        explicit basic_iterator (BaseIt it) : _it (it) {}
+
+        // iterator -> const_iterator
+        template <class V2, class B2>
+        basic_iterator (const basic_iterator<V2, B2>& v) : _it (v._it) {}
+
+        reference operator* () const { return **_it; }
+        pointer operator-> () const { return *_it; }
+        reference operator[] (difference_type n) const { return *_it[n]; }
+
+        basic_iterator& operator++ () { ++_it; return *this; }
+        basic_iterator& operator-- () { --_it; return *this; }
+        basic_iterator operator++ (int) { return basic_iterator (_it++); }
+        basic_iterator operator-- (int) { return basic_iterator (_it--); }
+        basic_iterator& operator+= (difference_type n) { _it += n; return *this; }
+        basic_iterator& operator-= (difference_type n) { _it -= n; return *this; }
+        basic_iterator operator+ (difference_type n) const { return basic_iterator (_it + n); }
+        basic_iterator operator- (difference_type n) const { return basic_iterator (_it - n); }
+
+        template <class V2, class B2>
+        difference_type operator- (const basic_iterator<V2, B2>& v) const { return _it - v._it; }
+        template <class V2, class B2>
+        bool operator== (const basic_iterator<V2, B2>& v) const { return _it == v._it; }
+        template <class V2, class B2>
+        bool operator!= (const basic_iterator<V2, B2>& v) const { return _it != v._it; }
+        template <class V2, class B2>
+        bool operator< (const basic_iterator<V2, B2>& v) const { return _it < v._it; }
+        template <class V2, class B2>
+        bool operator> (const basic_iterator<V2, B2>& v) const { return _it > v._it; }
+        template <class V2, class B2>
+        bool operator<= (const basic_iterator<V2, B2>& v) const { return _it <= v._it; }
+        template <class V2, class B2>
+        bool operator>= (const basic_iterator<V2, B2>& v) const { return _it >= v._it; }
+    };
+
+    typedef basic_iterator<T, typename index_type::iterator> iterator;
+    typedef basic_iterator<const T, typename index_type::const_iterator> const_iterator;
+
+    explicit ChunkedArray (const Alloc& alloc = Alloc ())
+        : _alloc (alloc), _items (alloc), _chunks (alloc),
+          _free (0), _chunkUsed (0), _chunkCapacity (0)
+    {
+    }
+
+    // копия получает аллокатор по умолчанию, а не аллокатор оригинала
+    ChunkedArray (const ChunkedArray<T, Alloc>& v, const Alloc& alloc = Alloc ())
+        : _alloc (alloc), _items (alloc), _chunks (alloc),
+          _free (0), _chunkUsed (0), _chunkCapacity (0)
+    {
+        assign (v.begin (), v.end (), v.size ());
+    }
+
+    ChunkedArray (ChunkedArray<T, Alloc>&& v)
+        : _alloc (v._alloc), _items (v._alloc), _chunks (v._alloc),
+          _free (0), _chunkUsed (0), _chunkCapacity (0)
+    {
+        swap (v);
+    }
+
+    template <class InputIt>
+    ChunkedArray (InputIt first, InputIt last, const Alloc& alloc = Alloc ())
+        : _alloc (alloc), _items (alloc), _chunks (alloc),
+          _free (0), _chunkUsed (0), _chunkCapacity (0)
+    {
+        assign (first, last, 0);
+    }
+
+    ~ChunkedArray ()
+    {
+        clear ();
+    }
+
+    ChunkedArray<T, Alloc>& operator= (const ChunkedArray<T, Alloc>& v)
+    {
+        if (&v != this)
+        {
+            clear ();
+            assign (v.begin (), v.end (), v.size ());
+        }
+        return *this;
+    }
+
+    ChunkedArray<T, Alloc>& operator= (ChunkedArray<T, Alloc>&& v)
+    {
+        if (&v != this)
+        {
+            clear ();
+            swap (v);
+        }
+        return *this;
+    }
+
+    allocator_type get_allocator () const { return _alloc; }
+
+    bool empty () const { return _items.empty (); }
+    size_type size () const { return _items.size (); }
+    size_type max_size () const { return _items.max_size (); }
+
+    iterator begin () { return iterator (_items.begin ()); }
+    const_iterator begin () const { return const_iterator (_items.begin ()); }
+    const_iterator cbegin () const { return const_iterator (_items.begin ()); }
+    iterator end () { return iterator (_items.end ()); }
+    const_iterator end () const { return const_iterator (_items.end ()); }
+    const_iterator cend () const { return const_iterator (_items.end ()); }
+
+    reference operator[] (size_type n) { return *_items[n]; }
+    const_reference operator[] (size_type n) const { return *_items[n]; }
+
+    reference front () { return *_items.front (); }
+    const_reference front () const { return *_items.front (); }
+    reference back () { return *_items.back (); }
+    const_reference back () const { return *_items.back (); }
+
+    void reserve (size_type n)
+    {
+        _items.reserve (n);
+    }
+
+    template <class... Args>
+    reference emplace_back (Args&&... args)
+    {
+        T* p = construct (std::forward<Args> (args)...);
+        try
+        {
+            _items.push_back (p);
+        }
+        catch (...)
+        {
+            release (p);
+            throw;
+        }
+        return *p;
+    }
+
+    void push_back (const T& v) { emplace_back (v); }
+    void push_back (T&& v) { emplace_back (std::move (v)); }
+
+    template <class... Args>
+    iterator emplace (const_iterator position, Args&&... args)
+    {
+        size_type n = position._it - _items.begin ();
+        T* p = construct (std::forward<Args> (args)...);
+        try
+        {
+            return iterator (_items.insert (_items.begin () + n, p));
+        }
+        catch (...)
+        {
+            release (p);
+            throw;
+        }
+    }
+
+    iterator insert (const_iterator position, const T& v)
+    {
+        return emplace (position, v);
+    }
+
+    iterator insert (const_iterator position, T&& v)
+    {
+        return emplace (position, std::move (v));
+    }
+
+    template <class InputIt>
+    iterator insert (const_iterator position, InputIt first, InputIt last)
+    {
+        size_type n = position._it - _items.begin ();
+        index_type added;
+        try
+        {
+            for (; first != last; ++first)
+            {
+                // ячейка под указатель заводится до элемента
+                added.push_back (0);
+                added.back () = construct (*first);
+            }
+            return iterator (_items.insert (_items.begin () + n,
+                                            added.begin (), added.end ()));
+        }
+        catch (...)
+        {
+            // если исключение бросил сам вставляемый элемент, его ячейка пуста
+            for (T* p : added)
+            {
+                if (p) release (p);
+            }
+            throw;
+        }
+    }
+
+    iterator erase (const_iterator position)
+    {
+        size_type n = position._it - _items.begin ();
+        release (_items[n]);
+        return iterator (_items.erase (_items.begin () + n));
+    }
+
+    ///
+    /// \brief erase_deferred разрушает n-й элемент, оставляя на его месте
+    /// пустую ячейку: указатели не сдвигаются, позиции остальных
+    /// не меняются. Пустую ячейку итератор узнаёт по operator-> () == 0;
+    /// копировать массив и сдвигать указатели (insert/erase) можно только
+    /// после compact()
+    ///
+    void erase_deferred (size_type n)
+    {
+        release (_items[n]);
+        _items[n] = 0;
+    }
+
+    /// убирает пустые ячейки, оставленные erase_deferred, за один проход
+    void compact ()
+    {
+        typename index_type::iterator out = _items.begin ();
+        for (T* p : _items)
+        {
+            if (p) *out++ = p;
+        }
+        _items.erase (out, _items.end ());
+    }
+
+    iterator erase (const_iterator first, const_iterator last)
+    {
+        size_type n = first._it - _items.begin ();
+        size_type m = last._it - _items.begin ();
+        for (size_type i = n; i < m; ++i) release (_items[i]);
+        return iterator (_items.erase (_items.begin () + n,
+                                       _items.begin () + m));
+    }
+
+    void pop_back ()
+    {
+        release (_items.back ());
+        _items.pop_back ();
+    }
+
+    void resize (size_type n)
+    {
+        while (_items.size () > n) pop_back ();
+        while (_items.size () < n) emplace_back ();
+    }
+
+    void clear ()
+    {
+        for (T* p : _items)
+        {
+            if (p) p->~T ();
+        }
+        _items.clear ();
+        for (const chunk_type& c : _chunks) _alloc.deallocate (c.first, c.second);
+        _chunks.clear ();
+        _free = 0;
+        _chunkUsed = _chunkCapacity = 0;
+    }
+
+    void swap (ChunkedArray<T, Alloc>& v)
+    {
+        std::swap (_alloc, v._alloc);
+        _items.swap (v._items);
+        _chunks.swap (v._chunks);
+        std::swap (_free, v._free);
+        std::swap (_chunkUsed, v._chunkUsed);
+        std::swap (_chunkCapacity, v._chunkCapacity);
+    }
+
+private:
+    enum { MIN_CHUNK = 4, MAX_CHUNK = 1024 };
+
+    template <class InputIt>
+    void assign (InputIt first, InputIt last, size_type hint)
+    {
+        if (hint) newChunk (hint);
+        _items.reserve (hint);
+        for (; first != last; ++first) emplace_back (*first);
+    }
+
+    void newChunk (size_type capacity)
+    {
+        _chunks.push_back (chunk_type (_alloc.allocate (capacity), capacity));
+        _chunkUsed = 0;
+        _chunkCapacity = capacity;
+    }
+
+    /* ячейка под новый элемент: из списка свободных или из последнего блока */
+    void* allocate ()
+    {
+        static_assert (sizeof (T) >= sizeof (void*),
+                       "ChunkedArray keeps free list inside released slots");
+        if (_free)
+        {
+            void* p = _free;
+            _free = *static_cast<void**> (_free);
+            return p;
+        }
+        if (_chunkUsed == _chunkCapacity)
+        {
+            // блоки растут вместе с массивом: маленькие массивы не тратят
+            // лишнего, большие обходятся немногими крупными блоками
+            size_type capacity = _items.size ();
+            if (capacity < MIN_CHUNK) capacity = MIN_CHUNK;
+            if (capacity > MAX_CHUNK) capacity = MAX_CHUNK;
+            newChunk (capacity);
+        }
+        return _chunks.back ().first + _chunkUsed++;
+    }
+
+    /* элемент в новой ячейке; если конструктор бросил, ячейка возвращается */
+    template <class... Args>
+    T* construct (Args&&... args)
+    {
+        void* slot = allocate ();
+        try
+        {
+            return new (slot) T (std::forward<Args> (args)...);
+        }
+        catch (...)
+        {
+            recycle (slot);
+            throw;
+        }
+    }
+
+    void recycle (void* p)
+    {
+        *static_cast<void**> (p) = _free;
+        _free = p;
+    }
+
+    void release (T* p)
+    {
+        p->~T ();
+        recycle (p);
+    }
+
+    Alloc _alloc;
+    index_type _items;
+    std::vector<chunk_type, chunk_alloc> _chunks;
+    void* _free;
+    size_type _chunkUsed;
+    size_type _chunkCapacity;
+};
+
+#endif // CHUNKEDARRAY_H
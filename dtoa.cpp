@@ -0,0 +1,644 @@
+#include "dtoa.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//
+// Grisu2 (F. Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers", PLDI 2010) с выбором цифр по границам
+// интервала округления: результат всегда читается обратно в то же
+// double. Примерно в 1% случаев Grisu2 не уверен, что цифры кратчайшие
+// и ближайшие к значению; тогда они уточняются через strtod/printf,
+// так что результат совпадает с Number.prototype.toString в ECMAScript.
+//
+// Таблица степеней десяти получена скриптом: 10^k для k = -300..324
+// с шагом 8, мантисса нормализована к 64 битам и округлена.
+//
+
+namespace
+{
+
+struct DiyFp
+{
+    uint64_t f;
+    int e;
+
+    DiyFp (uint64_t f_ = 0, int e_ = 0) : f (f_), e (e_) {}
+
+    static DiyFp sub (const DiyFp& x, const DiyFp& y)
+    {
+        return DiyFp (x.f - y.f, x.e);
+    }
+
+    /* старшие 64 бита произведения с округлением */
+    static DiyFp mul (const DiyFp& x, const DiyFp& y)
+    {
+        const uint64_t u_lo = x.f & 0xFFFFFFFFu;
+        const uint64_t u_hi = x.f >> 32;
+        const uint64_t v_lo = y.f & 0xFFFFFFFFu;
+        const uint64_t v_hi = y.f >> 32;
+
+        const uint64_t p0 = u_lo * v_lo;
+        const uint64_t p1 = u_lo * v_hi;
+        const uint64_t p2 = u_hi * v_lo;
+        const uint64_t p3 = u_hi * v_hi;
+
+        uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+        q += uint64_t (1) << 31;
+
+        return DiyFp (p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32), x.e + y.e + 64);
+    }
+
+    static DiyFp normalize (DiyFp x)
+    {
+        while ((x.f >> 63) == 0)
+        {
+            x.f <<= 1;
+            x.e--;
+        }
+        return x;
+    }
+
+    static DiyFp normalizeTo (const DiyFp& x, int e)
+    {
+        return DiyFp (x.f << (x.e - e), e);
+    }
+};
+
+struct Boundaries
+{
+    DiyFp w;
+    DiyFp minus;
+    DiyFp plus;
+};
+
+/* v = f * 2^e и середины расстояний до соседних double */
+Boundaries computeBoundaries (double value)
+{
+    const int kPrecision = 53;
+    const int kBias = 1023 + (kPrecision - 1);
+    const int kMinExp = 1 - kBias;
+    const uint64_t kHiddenBit = uint64_t (1) << (kPrecision - 1);
+
+    uint64_t bits;
+    memcpy (&bits, &value, sizeof (bits));
+    const uint64_t E = bits >> (kPrecision - 1);
+    const uint64_t F = bits & (kHiddenBit - 1);
+
+    const DiyFp v = (E == 0) ? DiyFp (F, kMinExp)
+                             : DiyFp (F + kHiddenBit, (int)E - kBias);
+
+    // у степени двойки нижний сосед вдвое ближе верхнего
+    const bool lowerCloser = (F == 0 && E > 1);
+    const DiyFp mPlus (2 * v.f + 1, v.e - 1);
+    const DiyFp mMinus = lowerCloser ? DiyFp (4 * v.f - 1, v.e - 2)
+                                     : DiyFp (2 * v.f - 1, v.e - 1);
+
+    Boundaries b;
+    b.plus = DiyFp::normalize (mPlus);
+    b.minus = DiyFp::normalizeTo (mMinus, b.plus.e);
+    b.w = DiyFp::normalize (v);
+    return b;
+}
+
+const int kAlpha = -60;
+const int kGamma = -32;
+
+struct CachedPower
+{
+    uint64_t f;
+    int e;
+    int k;
+};
+
+/* c = 10^k такое, что двоичный порядок произведения лежит в [kAlpha, kGamma] */
+CachedPower cachedPower (int e)
+{
+    static const CachedPower kCachedPowers[] =
+    {
+        { 0xAB70FE17C79AC6CA, -1060, -300 },
+        { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+        { 0xBE5691EF416BD60C, -1007, -284 },
+        { 0x8DD01FAD907FFC3C,  -980, -276 },
+        { 0xD3515C2831559A83,  -954, -268 },
+        { 0x9D71AC8FADA6C9B5,  -927, -260 },
+        { 0xEA9C227723EE8BCB,  -901, -252 },
+        { 0xAECC49914078536D,  -874, -244 },
+        { 0x823C12795DB6CE57,  -847, -236 },
+        { 0xC21094364DFB5637,  -821, -228 },
+        { 0x9096EA6F3848984F,  -794, -220 },
+        { 0xD77485CB25823AC7,  -768, -212 },
+        { 0xA086CFCD97BF97F4,  -741, -204 },
+        { 0xEF340A98172AACE5,  -715, -196 },
+        { 0xB23867FB2A35B28E,  -688, -188 },
+        { 0x84C8D4DFD2C63F3B,  -661, -180 },
+        { 0xC5DD44271AD3CDBA,  -635, -172 },
+        { 0x936B9FCEBB25C996,  -608, -164 },
+        { 0xDBAC6C247D62A584,  -582, -156 },
+        { 0xA3AB66580D5FDAF6,  -555, -148 },
+        { 0xF3E2F893DEC3F126,  -529, -140 },
+        { 0xB5B5ADA8AAFF80B8,  -502, -132 },
+        { 0x87625F056C7C4A8B,  -475, -124 },
+        { 0xC9BCFF6034C13053,  -449, -116 },
+        { 0x964E858C91BA2655,  -422, -108 },
+        { 0xDFF9772470297EBD,  -396, -100 },
+        { 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+        { 0xF8A95FCF88747D94,  -343,  -84 },
+        { 0xB94470938FA89BCF,  -316,  -76 },
+        { 0x8A08F0F8BF0F156B,  -289,  -68 },
+        { 0xCDB02555653131B6,  -263,  -60 },
+        { 0x993FE2C6D07B7FAC,  -236,  -52 },
+        { 0xE45C10C42A2B3B06,  -210,  -44 },
+        { 0xAA242499697392D3,  -183,  -36 },
+        { 0xFD87B5F28300CA0E,  -157,  -28 },
+        { 0xBCE5086492111AEB,  -130,  -20 },
+        { 0x8CBCCC096F5088CC,  -103,  -12 },
+        { 0xD1B71758E219652C,   -77,   -4 },
+        { 0x9C40000000000000,   -50,    4 },
+        { 0xE8D4A51000000000,   -24,   12 },
+        { 0xAD78EBC5AC620000,     3,   20 },
+        { 0x813F3978F8940984,    30,   28 },
+        { 0xC097CE7BC90715B3,    56,   36 },
+        { 0x8F7E32CE7BEA5C70,    83,   44 },
+        { 0xD5D238A4ABE98068,   109,   52 },
+        { 0x9F4F2726179A2245,   136,   60 },
+        { 0xED63A231D4C4FB27,   162,   68 },
+        { 0xB0DE65388CC8ADA8,   189,   76 },
+        { 0x83C7088E1AAB65DB,   216,   84 },
+        { 0xC45D1DF942711D9A,   242,   92 },
+        { 0x924D692CA61BE758,   269,  100 },
+        { 0xDA01EE641A708DEA,   295,  108 },
+        { 0xA26DA3999AEF774A,   322,  116 },
+        { 0xF209787BB47D6B85,   348,  124 },
+        { 0xB454E4A179DD1877,   375,  132 },
+        { 0x865B86925B9BC5C2,   402,  140 },
+        { 0xC83553C5C8965D3D,   428,  148 },
+        { 0x952AB45CFA97A0B3,   455,  156 },
+        { 0xDE469FBD99A05FE3,   481,  164 },
+        { 0xA59BC234DB398C25,   508,  172 },
+        { 0xF6C69A72A3989F5C,   534,  180 },
+        { 0xB7DCBF5354E9BECE,   561,  188 },
+        { 0x88FCF317F22241E2,   588,  196 },
+        { 0xCC20CE9BD35C78A5,   614,  204 },
+        { 0x98165AF37B2153DF,   641,  212 },
+        { 0xE2A0B5DC971F303A,   667,  220 },
+        { 0xA8D9D1535CE3B396,   694,  228 },
+        { 0xFB9B7CD9A4A7443C,   720,  236 },
+        { 0xBB764C4CA7A44410,   747,  244 },
+        { 0x8BAB8EEFB6409C1A,   774,  252 },
+        { 0xD01FEF10A657842C,   800,  260 },
+        { 0x9B10A4E5E9913129,   827,  268 },
+        { 0xE7109BFBA19C0C9D,   853,  276 },
+        { 0xAC2820D9623BF429,   880,  284 },
+        { 0x80444B5E7AA7CF85,   907,  292 },
+        { 0xBF21E44003ACDD2D,   933,  300 },
+        { 0x8E679C2F5E44FF8F,   960,  308 },
+        { 0xD433179D9C8CB841,   986,  316 },
+        { 0x9E19DB92B4E31BA9,  1013,  324 }
+    };
+
+    const int kMinDecExp = -300;
+    const int kDecStep = 8;
+
+    const int f = kAlpha - e - 1;
+    const int k = (f * 78913) / (1 << 18) + (f > 0 ? 1 : 0);
+    const int index = (-kMinDecExp + k + (kDecStep - 1)) / kDecStep;
+    return kCachedPowers[index];
+}
+
+int largestPow10 (uint32_t n, uint32_t& pow10)
+{
+    if (n >= 1000000000) { pow10 = 1000000000; return 10; }
+    if (n >= 100000000)  { pow10 = 100000000;  return 9; }
+    if (n >= 10000000)   { pow10 = 10000000;   return 8; }
+    if (n >= 1000000)    { pow10 = 1000000;    return 7; }
+    if (n >= 100000)     { pow10 = 100000;     return 6; }
+    if (n >= 10000)      { pow10 = 10000;      return 5; }
+    if (n >= 1000)       { pow10 = 1000;       return 4; }
+    if (n >= 100)        { pow10 = 100;        return 3; }
+    if (n >= 10)         { pow10 = 10;         return 2; }
+    pow10 = 1;
+    return 1;
+}
+
+/*
+ * Приближает последнюю цифру к w, не выходя из интервала округления.
+ * Возвращает false, если с учётом погрешности err соседнее значение
+ * может оказаться ближе к настоящему v
+ */
+bool round (char* buf, int len, uint64_t dist, uint64_t delta,
+            uint64_t rest, uint64_t tenK, uint64_t err)
+{
+    while (rest < dist && delta - rest >= tenK &&
+           (rest + tenK < dist || dist - rest > rest + tenK - dist))
+    {
+        buf[len - 1]--;
+        rest += tenK;
+    }
+    const uint64_t gap = rest > dist ? rest - dist : dist - rest;
+    return gap < tenK && tenK - gap > gap + 2 * err;
+}
+
+/*
+ * Цифры M+ порождаются, пока остаток не войдёт в суженный интервал.
+ * Кроме того, запоминается префикс на цифру короче: если он сам или
+ * следующее за ним число лишь на погрешность границ (err) не попали в
+ * интервал, то кратчайшее представление может оказаться короче
+ * найденного. Об этом, как и о неуверенном выборе последней цифры,
+ * сообщает uncertain.
+ */
+void digitGen (char* buf, int& len, int& decimalExponent, bool& uncertain,
+               DiyFp mMinus, DiyFp w, DiyFp mPlus)
+{
+    uint64_t delta = DiyFp::sub (mPlus, mMinus).f;
+    uint64_t dist = DiyFp::sub (mPlus, w).f;
+    uint64_t err = 2;
+
+    // prevRest -- насколько префикс без последней цифры ниже M+,
+    // prevUnit -- единица его младшего разряда (0, если префикса нет)
+    uint64_t prevRest = 0;
+    uint64_t prevUnit = 0;
+    uint64_t prevDelta = 0;
+    uint64_t prevErr = 0;
+
+    const DiyFp one (uint64_t (1) << -mPlus.e, mPlus.e);
+
+    uint32_t p1 = (uint32_t)(mPlus.f >> -one.e);
+    uint64_t p2 = mPlus.f & (one.f - 1);
+
+    uncertain = false;
+
+    // целая часть
+    uint32_t pow10;
+    int n = largestPow10 (p1, pow10);
+    while (n > 0)
+    {
+        const uint32_t d = p1 / pow10;
+        p1 %= pow10;
+        buf[len++] = (char)('0' + d);
+        --n;
+
+        const uint64_t unit = (uint64_t)pow10 << -one.e;
+        const uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta)
+        {
+            decimalExponent += n;
+            uncertain = prevUnit && (prevRest <= prevDelta + prevErr ||
+                                     prevUnit - prevRest <= prevErr);
+            if (!round (buf, len, dist, delta, rest, unit, err)) uncertain = true;
+            return;
+        }
+        prevRest = rest;
+        prevUnit = unit;
+        prevDelta = delta;
+        prevErr = err;
+        pow10 /= 10;
+    }
+
+    // дробная часть
+    int m = 0;
+    for (;;)
+    {
+        prevRest = p2;
+        prevUnit = one.f;
+        prevDelta = delta;
+        prevErr = err;
+
+        p2 *= 10;
+        const uint64_t d = p2 >> -one.e;
+        p2 &= one.f - 1;
+        buf[len++] = (char)('0' + d);
+        ++m;
+
+        delta *= 10;
+        dist *= 10;
+        err *= 10;
+        if (p2 <= delta) break;
+    }
+    decimalExponent -= m;
+    uncertain = prevRest <= prevDelta + prevErr || prevUnit - prevRest <= prevErr;
+    if (!round (buf, len, dist, delta, p2, one.f, err)) uncertain = true;
+}
+
+/* цифры buf[0..len) и порядок: value = digits * 10^decimalExponent */
+void grisu2 (char* buf, int& len, int& decimalExponent, bool& uncertain,
+             double value)
+{
+    const Boundaries b = computeBoundaries (value);
+    const CachedPower cached = cachedPower (b.plus.e);
+    const DiyFp c (cached.f, cached.e);
+
+    const DiyFp w = DiyFp::mul (b.w, c);
+    const DiyFp wMinus = DiyFp::mul (b.minus, c);
+    const DiyFp wPlus = DiyFp::mul (b.plus, c);
+
+    // сужаем интервал на единицу с каждой стороны, чтобы покрыть
+    // погрешность умножения
+    const DiyFp mMinus (wMinus.f + 1, wMinus.e);
+    const DiyFp mPlus (wPlus.f - 1, wPlus.e);
+
+    len = 0;
+    decimalExponent = -cached.k;
+    digitGen (buf, len, decimalExponent, uncertain, mMinus, w, mPlus);
+}
+
+/* читается ли digits * 10^e обратно в value (strtod округляет точно) */
+bool roundTrips (const char* digits, int len, int e, double value)
+{
+    char buf[48];
+    memcpy (buf, digits, (size_t)len);
+    char* p = buf + len;
+    *p++ = 'e';
+    if (e < 0)
+    {
+        *p++ = '-';
+        e = -e;
+    }
+    char tmp[8];
+    int n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + e % 10);
+        e /= 10;
+    }
+    while (e);
+    while (n) *p++ = tmp[--n];
+    *p = 0;
+    // без десятичной точки разбор от локали не зависит
+    return strtod (buf, 0) == value;
+}
+
+/*
+ * Редкий случай, когда Grisu2 из-за сужения интервала выдал лишние
+ * цифры: пробуем префикс на цифру короче и следующее за ним число,
+ * проверяя их обратным разбором. Из двух подходящих берётся ближайшее.
+ */
+void shorten (char* digits, int& len, int& e, double value)
+{
+    while (len > 1)
+    {
+        char lo[32];
+        char hi[32];
+        const int loLen = len - 1;
+        memcpy (lo, digits, (size_t)loLen);
+        memcpy (hi, digits, (size_t)loLen);
+
+        int hiLen = loLen;
+        int hiExp = e + 1;
+        int i = loLen - 1;
+        while (i >= 0 && hi[i] == '9') hi[i--] = '0';
+        if (i < 0)
+        {
+            hi[0] = '1';
+            hiLen = 1;
+            hiExp = e + 1 + loLen;
+        }
+        else
+        {
+            hi[i]++;
+        }
+
+        const bool loFits = roundTrips (lo, loLen, e + 1, value);
+        const bool hiFits = roundTrips (hi, hiLen, hiExp, value);
+        if (hiFits && (!loFits || digits[len - 1] >= '5'))
+        {
+            memcpy (digits, hi, (size_t)hiLen);
+            len = hiLen;
+            e = hiExp;
+        }
+        else if (loFits)
+        {
+            memcpy (digits, lo, (size_t)loLen);
+            len = loLen;
+            e = e + 1;
+        }
+        else
+        {
+            break;
+        }
+        while (len > 1 && digits[len - 1] == '0')
+        {
+            --len;
+            ++e;
+        }
+    }
+}
+
+/*
+ * Ближайшее к value число из len значащих цифр: printf округляет точно
+ * (половину -- к чётному). Десятичный разделитель зависит от локали,
+ * поэтому берутся только цифры
+ */
+void exactDigits (char* digits, int len, int& e, double value)
+{
+    char buf[48];
+    snprintf (buf, sizeof (buf), "%.*e", len - 1, value);
+
+    const char* p = buf;
+    int n = 0;
+    for (; *p != 'e'; ++p)
+    {
+        if (*p >= '0' && *p <= '9') digits[n++] = *p;
+    }
+    e = atoi (p + 1) - (len - 1);
+}
+
+/*
+ * Кратчайшие цифры положительного value, а среди равных по длине --
+ * ближайшие к нему (при равенстве -- с чётной последней цифрой), как
+ * требует ECMAScript. Grisu2 почти всегда даёт именно их; в редких
+ * сомнительных случаях длина уточняется обратным разбором, а цифры --
+ * точным округлением
+ */
+void shortestDigits (char* digits, int& len, int& e, double value)
+{
+    bool uncertain;
+    grisu2 (digits, len, e, uncertain, value);
+    while (len > 1 && digits[len - 1] == '0')
+    {
+        --len;
+        ++e;
+    }
+    if (!uncertain) return;
+
+    shorten (digits, len, e, value);
+    exactDigits (digits, len, e, value);
+    while (len > 1 && digits[len - 1] == '0')
+    {
+        --len;
+        ++e;
+    }
+}
+
+char* writeExponent (char* p, int e)
+{
+    if (e < 0)
+    {
+        *p++ = '-';
+        e = -e;
+    }
+    else
+    {
+        *p++ = '+';
+    }
+
+    if (e >= 100)
+    {
+        *p++ = (char)('0' + e / 100);
+        e %= 100;
+    }
+    *p++ = (char)('0' + e / 10);
+    *p++ = (char)('0' + e % 10);
+    return p;
+}
+
+} // namespace
+
+size_t formatShortest (char* buf, double value)
+{
+    char* p = buf;
+
+    uint64_t bits;
+    memcpy (&bits, &value, sizeof (bits));
+    if (bits >> 63)
+    {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if (value == 0)
+    {
+        memcpy (p, "0.0", 3);
+        return (size_t)(p + 3 - buf);
+    }
+
+    char digits[32];
+    int k = 0;
+    int e = 0;
+    shortestDigits (digits, k, e, value);
+
+    // n -- позиция десятичной точки относительно первой цифры;
+    // порядок в экспоненциальной записи на единицу меньше: n - 1
+    const int n = k + e;
+    const int kMinExp = -4;
+    const int kMaxExp = 15;
+
+    if (k <= n && n - 1 <= kMaxExp)
+    {
+        // целое: 1234e2 -> 123400.0
+        memcpy (p, digits, (size_t)k);
+        p += k;
+        for (int i = k; i < n; ++i) *p++ = '0';
+        *p++ = '.';
+        *p++ = '0';
+    }
+    else if (0 < n && n - 1 <= kMaxExp)
+    {
+        // 1234e-2 -> 12.34
+        memcpy (p, digits, (size_t)n);
+        p += n;
+        *p++ = '.';
+        memcpy (p, digits + n, (size_t)(k - n));
+        p += k - n;
+    }
+    else if (kMinExp <= n - 1 && n <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = n; i < 0; ++i) *p++ = '0';
+        memcpy (p, digits, (size_t)k);
+        p += k;
+    }
+    else
+    {
+        // 1234e30 -> 1.234e+33
+        *p++ = digits[0];
+        if (k > 1)
+        {
+            *p++ = '.';
+            memcpy (p, digits + 1, (size_t)(k - 1));
+            p += k - 1;
+        }
+        *p++ = 'e';
+        p = writeExponent (p, n - 1);
+    }
+    return (size_t)(p - buf);
+}
+
+size_t formatEcmaScript (char* buf, double value)
+{
+    char* p = buf;
+
+    if (value < 0)
+    {
+        *p++ = '-';
+        value = -value;
+    }
+    else if (value == 0)
+    {
+        // и -0 тоже
+        *p = '0';
+        return 1;
+    }
+
+    char digits[32];
+    int k = 0;
+    int e = 0;
+    shortestDigits (digits, k, e, value);
+
+    const int n = k + e;
+    if (k <= n && n <= 21)
+    {
+        // 1234e2 -> 123400
+        memcpy (p, digits, (size_t)k);
+        p += k;
+        for (int i = k; i < n; ++i) *p++ = '0';
+    }
+    else if (0 < n && n <= 21)
+    {
+        // 1234e-2 -> 12.34
+        memcpy (p, digits, (size_t)n);
+        p += n;
+        *p++ = '.';
+        memcpy (p, digits + n, (size_t)(k - n));
+        p += k - n;
+    }
+    else if (-6 < n && n <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = n; i < 0; ++i) *p++ = '0';
+        memcpy (p, digits, (size_t)k);
+        p += k;
+    }
+    else
+    {
+        // 1234e30 -> 1.234e+33, 1e-7
+        *p++ = digits[0];
+        if (k > 1)
+        {
+            *p++ = '.';
+            memcpy (p, digits + 1, (size_t)(k - 1));
+            p += k - 1;
+        }
+        *p++ = 'e';
+        int x = n - 1;
+        if (x < 0)
+        {
+            *p++ = '-';
+            x = -x;
+        }
+        else
+        {
+            *p++ = '+';
+        }
+        if (x >= 100) *p++ = (char)('0' + x / 100);
+        if (x >= 10) *p++ = (char)('0' + x / 10 % 10);
+        *p++ = (char)('0' + x % 10);
+    }
+    return (size_t)(p - buf);
+}
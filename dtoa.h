@@ -0,0 +1,28 @@
+#ifndef DTOA_H
+#define DTOA_H
+
+#include <cstddef>
+
+///
+/// \brief formatShortest печатает конечное double кратчайшей строкой,
+/// которая читается обратно (strtod) в то же самое значение.
+///
+/// Целые значения получают ".0" (1.0, 100.0), чтобы при разборе
+/// остаться числами с плавающей точкой; порядки вне [-4, 15] пишутся
+/// в экспоненциальной форме (1.5e+20, 2e-07).
+/// buf должен вмещать не меньше 32 байт; нуль в конце не пишется.
+/// \return число записанных символов
+///
+size_t formatShortest (char* buf, double value);
+
+///
+/// \brief formatEcmaScript печатает конечное double так же, как
+/// Number.prototype.toString в ECMAScript (этого требует каноническая
+/// форма RFC 8785): кратчайшие цифры без ".0" у целых, -0 как 0,
+/// экспоненциальная форма вне [1e-7, 1e21) -- 1e+21, 1.5e-7.
+/// buf должен вмещать не меньше 32 байт; нуль в конце не пишется.
+/// \return число записанных символов
+///
+size_t formatEcmaScript (char* buf, double value);
+
+#endif // DTOA_H
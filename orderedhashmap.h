@@ -0,0 +1,599 @@
+#ifndef ORDEREDHASHMAP_H
+#define ORDEREDHASHMAP_H
+
+#include "chunkedarray.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+///
+/// OrderedHashMap -- ассоциативный контейнер, сохраняющий порядок вставки,
+/// с поиском по ключу за O(1) в среднем.
+///
+/// Пары ключ-значение лежат плотно в ChunkedArray (порядок + стабильные
+/// адреса), а поверх них строится индекс с открытой адресацией:
+/// ячейка индекса -- это просто указатель на пару. Ключ хранится один раз.
+/// Для маленьких объектов (до SMALL_SIZE членов) индекс не строится
+/// вовсе, поиск идёт перебором -- так дешевле и по памяти, и по времени.
+///
+/// Интерфейс повторяет LinkedMap: insert существующего ключа переносит его
+/// в новую позицию, итераторы двунаправленные. Вся память берётся
+/// из аллокатора Alloc.
+///
+/// Каждая пара помнит свою ячейку, так что find и erase по ключу
+/// не ищут её перебором. erase по ключу оставляет на месте пары пустую
+/// ячейку, итераторы её перешагивают. Пустые ячейки убираются одним
+/// проходом, когда их становится больше, чем пар, и при позиционных
+/// вставке и удалении (они и так O(n)); чтение их не трогает, поэтому
+/// константные методы можно звать из нескольких потоков. Пока пустые
+/// ячейки есть, nth и position считают позицию перебором.
+/// erase по ключу делает недействительными все итераторы.
+///
+/// sorted() отдаёт члены в порядке ключей по Less. Этот порядок
+/// считается один раз и живёт до первого добавления или удаления ключа;
+/// изменение значений его не сбрасывает.
+///
+template <class K, class T, class Hash = std::hash<K>,
+          class Alloc = std::allocator<std::pair<const K, T> >,
+          class Less = std::less<K> >
+class OrderedHashMap
+{
+public:
+    typedef std::pair<const K, T> value_type;
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef Alloc allocator_type;
+
+    /* пара и номер её ячейки в value_list */
+    struct entry_type : value_type
+    {
+        entry_type (const value_type& v) : value_type (v), ordinal (0) {}
+        entry_type (value_type&& v) : value_type (std::move (v)), ordinal (0) {}
+
+        size_t ordinal;
+    };
+
+    typedef typename std::allocator_traits<Alloc>::template
+        rebind_alloc<entry_type> entry_alloc;
+    typedef typename std::allocator_traits<Alloc>::template
+        rebind_alloc<entry_type*> index_alloc;
+    typedef ChunkedArray<entry_type, entry_alloc> list_type;
+    typedef typename list_type::size_type size_type;
+
+    /* итератор по value_list, перешагивающий пустые ячейки */
+    template <class V, class It>
+    class basic_iterator
+    {
+        It _it;
+        It _end;
+
+        template <class, class> friend class basic_iterator;
+        friend class OrderedHashMap;
+
+        basic_iterator (It it, It end) : _it (it), _end (end) {}
+
+        bool hole () const { return _it.operator-> () == 0; }
+
+        void skip ()
+        {
+            while (_it != _end && hole ()) ++_it;
+        }
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const K, T> value_type;
+        typedef ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        basic_iterator () : _it (), _end () {}
+
+        // iterator -> const_iterator
+        template <class V2, class It2>
+        basic_iterator (const basic_iterator<V2, It2>& v) : _it (v._it), _end (v._end) {}
+
+        reference operator* () const { return *_it; }
+        pointer operator-> () const { return &*_it; }
+
+        basic_iterator& operator++ () { ++_it; skip (); return *this; }
+        // перед первой парой пустых ячеек нет: их перешагивает begin ()
+        basic_iterator& operator-- () { do --_it; while (hole ()); return *this; }
+        basic_iterator operator++ (int) { basic_iterator i (*this); ++*this; return i; }
+        basic_iterator operator-- (int) { basic_iterator i (*this); --*this; return i; }
+
+        template <class V2, class It2>
+        bool operator== (const basic_iterator<V2, It2>& v) const { return _it == v._it; }
+        template <class V2, class It2>
+        bool operator!= (const basic_iterator<V2, It2>& v) const { return _it != v._it; }
+    };
+
+    typedef basic_iterator<value_type, typename list_type::iterator> iterator;
+    typedef basic_iterator<const value_type,
+                           typename list_type::const_iterator> const_iterator;
+
+    explicit OrderedHashMap (const Alloc& alloc = Alloc ())
+        : value_list (alloc), index (alloc), order (0), holes (0)
+    {
+    }
+
+    // копия получает аллокатор по умолчанию, а не аллокатор оригинала
+    OrderedHashMap (const OrderedHashMap& map, const Alloc& alloc = Alloc ())
+        : value_list (alloc), index (alloc), order (0), holes (0)
+    {
+        assign (map);
+    }
+
+    OrderedHashMap (OrderedHashMap&& map)
+        : value_list (map.get_allocator ()), index (map.get_allocator ()),
+          order (0), holes (0)
+    {
+        swap (map);
+    }
+
+    template <class InputIt>
+    OrderedHashMap (InputIt first, InputIt last, const Alloc& alloc = Alloc ())
+        : value_list (alloc), index (alloc), order (0), holes (0)
+    {
+        for (InputIt i = first; i != last; ++i)
+        {
+            insert (value_type (i->first, i->second));
+        }
+    }
+
+    ~OrderedHashMap ()
+    {
+        reset_order ();
+    }
+
+    OrderedHashMap& operator= (const OrderedHashMap& map)
+    {
+        if (&map != this)
+        {
+            clear ();
+            assign (map);
+        }
+        return *this;
+    }
+
+    OrderedHashMap& operator= (OrderedHashMap&& map)
+    {
+        if (&map != this)
+        {
+            clear ();
+            swap (map);
+        }
+        return *this;
+    }
+
+    allocator_type get_allocator () const
+    {
+        return allocator_type (value_list.get_allocator ());
+    }
+
+    bool empty () const
+    {
+        return size () == 0;
+    }
+
+    size_type size () const
+    {
+        return value_list.size () - holes;
+    }
+
+    size_type max_size () const
+    {
+        return value_list.max_size ();
+    }
+
+    iterator begin ()
+    {
+        iterator i = make_iterator (value_list.begin ());
+        if (holes) i.skip ();
+        return i;
+    }
+
+    const_iterator begin () const
+    {
+        const_iterator i = make_iterator (value_list.cbegin ());
+        if (holes) i.skip ();
+        return i;
+    }
+
+    const_iterator cbegin () const
+    {
+        return begin ();
+    }
+
+    iterator end ()
+    {
+        return make_iterator (value_list.end ());
+    }
+
+    const_iterator end () const
+    {
+        return make_iterator (value_list.cend ());
+    }
+
+    const_iterator cend () const
+    {
+        return end ();
+    }
+
+    /* итератор на n-ю пару; без пустых ячеек за O(1) */
+    iterator nth (size_type n)
+    {
+        if (holes == 0) return make_iterator (value_list.begin () + n);
+        iterator i = begin ();
+        while (n--) ++i;
+        return i;
+    }
+
+    const_iterator nth (size_type n) const
+    {
+        if (holes == 0) return make_iterator (value_list.cbegin () + n);
+        const_iterator i = begin ();
+        while (n--) ++i;
+        return i;
+    }
+
+    /* позиция пары под итератором; без пустых ячеек и для последней пары за O(1) */
+    size_type position (const_iterator i) const
+    {
+        if (holes == 0) return (size_type)(i._it - value_list.cbegin ());
+        if (i != end () && i._it + 1 == value_list.cend ()) return size () - 1;
+        size_type n = 0;
+        for (const_iterator j = begin (); j != i; ++j) ++n;
+        return n;
+    }
+
+    mapped_type& operator[] (const key_type& key)
+    {
+        entry_type* p = lookup (key);
+        if (p == 0) p = &append (value_type (key, T ()));
+        return p->second;
+    }
+
+    mapped_type& operator[] (key_type&& key)
+    {
+        entry_type* p = lookup (key);
+        if (p == 0) p = &append (value_type (std::move (key), T ()));
+        return p->second;
+    }
+
+    mapped_type& at (const key_type& key)
+    {
+        return lookup (key)->second;
+    }
+
+    const mapped_type& at (const key_type& key) const
+    {
+        return lookup (key)->second;
+    }
+
+    /* указатель на значение или 0 -- поиск без построения итератора */
+    mapped_type* get (const key_type& key)
+    {
+        entry_type* p = lookup (key);
+        return p ? &p->second : 0;
+    }
+
+    const mapped_type* get (const key_type& key) const
+    {
+        entry_type* p = lookup (key);
+        return p ? &p->second : 0;
+    }
+
+    iterator find (const key_type& key)
+    {
+        entry_type* p = lookup (key);
+        return p ? make_iterator (value_list.begin () + p->ordinal) : end ();
+    }
+
+    const_iterator find (const key_type& key) const
+    {
+        entry_type* p = lookup (key);
+        return p ? make_iterator (value_list.cbegin () + p->ordinal) : end ();
+    }
+
+    bool has_key (const key_type& key) const
+    {
+        return lookup (key) != 0;
+    }
+
+    iterator insert (const key_type& key, const mapped_type& value)
+    {
+        return insert (value_type (key, value));
+    }
+
+    iterator insert (const value_type& value)
+    {
+        erase (value.first);
+        entry_type& v = append (value);
+        return make_iterator (value_list.begin () + v.ordinal);
+    }
+
+    iterator insert (const_iterator position, const key_type& key,
+                     const mapped_type& value)
+    {
+        return insert (position, value_type (key, value));
+    }
+
+    /* позиционные вставка и удаление и так O(n): заодно убирают пустые ячейки */
+    iterator insert (const_iterator position, const value_type& value)
+    {
+        size_type n = this->position (position);
+        settle ();
+        entry_type* old = lookup (value.first);
+        if (old)
+        {
+            size_type m = old->ordinal;
+            if (m < n) --n;
+            erase_at (m);
+        }
+
+        typename list_type::iterator iter = value_list.insert (value_list.cbegin () + n, value);
+        renumber (n);
+        link (&*iter);
+        return make_iterator (value_list.begin () + n);
+    }
+
+    iterator erase (const_iterator position)
+    {
+        size_type n = this->position (position);
+        settle ();
+        erase_at (n);
+        return make_iterator (value_list.begin () + n);
+    }
+
+    size_type erase (const key_type& key)
+    {
+        entry_type* p = lookup (key);
+        if (p == 0) return 0;
+
+        if (index.empty ())
+        {
+            // в маленьком объекте сдвинуть несколько указателей дешевле
+            erase_at (p->ordinal);
+            return 1;
+        }
+
+        unlink (key);
+        value_list.erase_deferred (p->ordinal);
+        // пустых ячеек не больше, чем пар: уплотнение амортизировано
+        if (++holes * 2 > value_list.size ()) settle ();
+        return 1;
+    }
+
+    iterator erase (const_iterator first, const_iterator last)
+    {
+        size_type n = position (first);
+        size_type m = position (last);
+        settle ();
+        for (size_type i = n; i < m; ++i) unlink (value_list[i].first);
+        value_list.erase (value_list.cbegin () + n, value_list.cbegin () + m);
+        renumber (n);
+        return make_iterator (value_list.begin () + n);
+    }
+
+    void clear ()
+    {
+        reset_order ();
+        index.clear ();
+        value_list.clear ();
+        holes = 0;
+    }
+
+    void swap (OrderedHashMap& map)
+    {
+        value_list.swap (map.value_list);
+        index.swap (map.index);
+        // адреса пар при обмене не меняются, поэтому порядок переезжает вместе с ними
+        map.order.store (order.exchange (map.order.load ()));
+        std::swap (holes, map.holes);
+    }
+
+    /*
+     * Массив из size() указателей на пары в порядке Less. Его можно
+     * запрашивать из нескольких потоков сразу: построивший массив первым
+     * публикует его, остальные свой выбрасывают. Память берётся из malloc,
+     * а не из Alloc -- арена не рассчитана на одновременные запросы.
+     */
+    const value_type* const* sorted () const
+    {
+        value_type** p = order.load (std::memory_order_acquire);
+        if (p || empty ()) return p;
+
+        p = (value_type**)malloc (size () * sizeof (value_type*));
+        if (p == 0) throw std::bad_alloc ();
+        size_type n = 0;
+        for (const value_type& v : *this) p[n++] = const_cast<value_type*> (&v);
+        std::sort (p, p + n, [](const value_type* a, const value_type* b)
+        {
+            return Less () (a->first, b->first);
+        });
+
+        value_type** expected = 0;
+        if (!order.compare_exchange_strong (expected, p, std::memory_order_acq_rel))
+        {
+            free (p);
+            p = expected;
+        }
+        return p;
+    }
+
+private:
+    enum { SMALL_SIZE = 8 };
+
+    size_type slot (const key_type& key) const
+    {
+        return Hash () (key) & (index.size () - 1);
+    }
+
+    /* без индекса пустых ячеек не бывает: их оставляет только erase
+       по ключу в большом объекте, а rehash их убирает */
+    entry_type* lookup (const key_type& key) const
+    {
+        if (index.empty ())
+        {
+            for (const entry_type& v : value_list)
+            {
+                if (v.first == key) return const_cast<entry_type*> (&v);
+            }
+            return 0;
+        }
+
+        for (size_type i = slot (key); index[i]; i = (i + 1) & (index.size () - 1))
+        {
+            if (index[i]->first == key) return index[i];
+        }
+        return 0;
+    }
+
+    iterator make_iterator (typename list_type::iterator i)
+    {
+        return iterator (i, value_list.end ());
+    }
+
+    const_iterator make_iterator (typename list_type::const_iterator i) const
+    {
+        return const_iterator (i, value_list.cend ());
+    }
+
+    /* копирует пары map подряд, без пустых ячеек */
+    void assign (const OrderedHashMap& map)
+    {
+        value_list.reserve (map.size ());
+        for (const value_type& v : map)
+        {
+            entry_type& e = value_list.emplace_back (v);
+            e.ordinal = value_list.size () - 1;
+        }
+        rehash ();
+    }
+
+    /* убирает пустые ячейки и заново нумерует пары */
+    void settle ()
+    {
+        if (holes == 0) return;
+        value_list.compact ();
+        holes = 0;
+        renumber (0);
+    }
+
+    /* нумерует пары с n-й; пустых ячеек быть не должно */
+    void renumber (size_type n)
+    {
+        for (typename list_type::iterator i = value_list.begin () + n;
+             i != value_list.end (); ++i)
+        {
+            i->ordinal = n++;
+        }
+    }
+
+    /* удаляет n-ю пару со сдвигом; пустых ячеек быть не должно */
+    void erase_at (size_type n)
+    {
+        unlink (value_list[n].first);
+        value_list.erase (value_list.cbegin () + n);
+        renumber (n);
+    }
+
+    entry_type& append (const value_type& value)
+    {
+        entry_type& v = value_list.emplace_back (value);
+        v.ordinal = value_list.size () - 1;
+        link (&v);
+        return v;
+    }
+
+    entry_type& append (value_type&& value)
+    {
+        entry_type& v = value_list.emplace_back (std::move (value));
+        v.ordinal = value_list.size () - 1;
+        link (&v);
+        return v;
+    }
+
+    /* добавляет в индекс уже вставленную в value_list пару */
+    void link (entry_type* p)
+    {
+        reset_order ();
+        // заполненность индекса держим не выше половины
+        if (index.empty () ? size () > SMALL_SIZE : size () * 2 > index.size ())
+        {
+            rehash ();
+            return;
+        }
+        if (index.empty ()) return;
+
+        size_type i = slot (p->first);
+        while (index[i]) i = (i + 1) & (index.size () - 1);
+        index[i] = p;
+    }
+
+    /* убирает ключ из индекса, сдвигая назад хвост цепочки */
+    void unlink (const key_type& key)
+    {
+        reset_order ();
+        if (index.empty ()) return;
+
+        size_type mask = index.size () - 1;
+        size_type i = slot (key);
+        while (index[i]->first != key) i = (i + 1) & mask;
+
+        for (size_type j = (i + 1) & mask; index[j]; j = (j + 1) & mask)
+        {
+            size_type k = slot (index[j]->first);
+            // ячейка j может занять освободившуюся i, если её "родная"
+            // ячейка k не лежит циклически в (i, j]
+            if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+            {
+                index[i] = index[j];
+                i = j;
+            }
+        }
+        index[i] = 0;
+    }
+
+    void rehash ()
+    {
+        reset_order ();
+        settle ();
+        index.clear ();
+        if (size () <= SMALL_SIZE) return;
+
+        size_type capacity = 16;
+        while (capacity < size () * 4) capacity *= 2;
+        index.assign (capacity, 0);
+
+        for (entry_type& v : value_list)
+        {
+            size_type i = slot (v.first);
+            while (index[i]) i = (i + 1) & (capacity - 1);
+            index[i] = &v;
+        }
+    }
+
+    void reset_order ()
+    {
+        // reset_order зовётся на каждой вставке, а порядок построен редко:
+        // обмен нужен, только если он есть
+        if (order.load (std::memory_order_relaxed) == 0) return;
+        value_type** p = order.exchange (0);
+        if (p) free (p);
+    }
+
+    list_type value_list;
+    std::vector<entry_type*, index_alloc> index;
+    mutable std::atomic<value_type**> order;
+    // число пустых ячеек в value_list
+    size_type holes;
+};
+
+#endif // ORDEREDHASHMAP_H
@@ -0,0 +1,144 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+typedef size_t (*FindFunction) (const char* s, size_t size);
+
+struct Kernel
+{
+    FindFunction findEscape;
+    const char* name;
+};
+
+inline bool needsEscape (unsigned char c)
+{
+    return c < 0x20 || c == '\"' || c == '\\' || c == '/';
+}
+
+size_t findEscapeScalar (const char* s, size_t size)
+{
+    size_t i = 0;
+    while (i < size && !needsEscape ((unsigned char)s[i])) ++i;
+    return i;
+}
+
+#ifdef SCAN_X86
+
+/*
+ * Байт c < 0x20 ищется как max(c, 0x1f) == 0x1f (беззнаковое сравнение
+ * в SSE есть только через max/min), остальные три -- прямым сравнением.
+ * Хвост короче регистра досматривается побайтово, поэтому чтения за
+ * пределы строки нет.
+ */
+__attribute__ ((target ("sse2")))
+size_t findEscapeSse2 (const char* s, size_t size)
+{
+    const __m128i quote = _mm_set1_epi8 ('\"');
+    const __m128i backslash = _mm_set1_epi8 ('\\');
+    const __m128i slash = _mm_set1_epi8 ('/');
+    const __m128i control = _mm_set1_epi8 (0x1f);
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i x = _mm_loadu_si128 ((const __m128i*)(s + i));
+        __m128i m = _mm_or_si128 (
+            _mm_or_si128 (_mm_cmpeq_epi8 (x, quote), _mm_cmpeq_epi8 (x, backslash)),
+            _mm_or_si128 (_mm_cmpeq_epi8 (x, slash),
+                          _mm_cmpeq_epi8 (_mm_max_epu8 (x, control), control)));
+        unsigned mask = (unsigned)_mm_movemask_epi8 (m);
+        if (mask) return i + (size_t)__builtin_ctz (mask);
+    }
+    while (i < size && !needsEscape ((unsigned char)s[i])) ++i;
+    return i;
+}
+
+/*
+ * Хвост AVX2-варианта досматривается здесь же, а не вызовом SSE2-варианта:
+ * переход от AVX-кода с грязными старшими половинами ymm к обычному
+ * SSE-коду стоит дорого, и компилятор ставит vzeroupper только на выходе
+ */
+__attribute__ ((target ("avx2")))
+size_t findEscapeAvx2 (const char* s, size_t size)
+{
+    size_t i = 0;
+    if (size >= 32)
+    {
+        const __m256i quote = _mm256_set1_epi8 ('\"');
+        const __m256i backslash = _mm256_set1_epi8 ('\\');
+        const __m256i slash = _mm256_set1_epi8 ('/');
+        const __m256i control = _mm256_set1_epi8 (0x1f);
+
+        for (; i + 32 <= size; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256 ((const __m256i*)(s + i));
+            __m256i m = _mm256_or_si256 (
+                _mm256_or_si256 (_mm256_cmpeq_epi8 (x, quote), _mm256_cmpeq_epi8 (x, backslash)),
+                _mm256_or_si256 (_mm256_cmpeq_epi8 (x, slash),
+                                 _mm256_cmpeq_epi8 (_mm256_max_epu8 (x, control), control)));
+            unsigned mask = (unsigned)_mm256_movemask_epi8 (m);
+            if (mask) return i + (size_t)__builtin_ctz (mask);
+        }
+    }
+    if (i + 16 <= size)
+    {
+        __m128i x = _mm_loadu_si128 ((const __m128i*)(s + i));
+        __m128i control = _mm_set1_epi8 (0x1f);
+        __m128i m = _mm_or_si128 (
+            _mm_or_si128 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\"')),
+                          _mm_cmpeq_epi8 (x, _mm_set1_epi8 ('\\'))),
+            _mm_or_si128 (_mm_cmpeq_epi8 (x, _mm_set1_epi8 ('/')),
+                          _mm_cmpeq_epi8 (_mm_max_epu8 (x, control), control)));
+        unsigned mask = (unsigned)_mm_movemask_epi8 (m);
+        if (mask) return i + (size_t)__builtin_ctz (mask);
+        i += 16;
+    }
+    while (i < size && !needsEscape ((unsigned char)s[i])) ++i;
+    return i;
+}
+
+#endif // SCAN_X86
+
+Kernel selectKernel ()
+{
+    Kernel k = { findEscapeScalar, "scalar" };
+#ifdef SCAN_X86
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+    {
+        k.findEscape = findEscapeAvx2;
+        k.name = "avx2";
+    }
+    else if (__builtin_cpu_supports ("sse2"))
+    {
+        k.findEscape = findEscapeSse2;
+        k.name = "sse2";
+    }
+#endif
+    return k;
+}
+
+const Kernel& kernel ()
+{
+    // инициализация локальной статической переменной потокобезопасна
+    static const Kernel k = selectKernel ();
+    return k;
+}
+
+} // namespace
+
+size_t findEscape (const char* s, size_t size)
+{
+    return kernel ().findEscape (s, size);
+}
+
+const char* scanKernel ()
+{
+    return kernel ().name;
+}
@@ -0,0 +1,22 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+
+///
+/// \brief findEscape ищет первый байт, который в JSON-строке нужно
+/// экранировать: управляющие символы (< 0x20), '"', '\\' и '/'.
+///
+/// На x86 строка просматривается по 32 (AVX2) или 16 (SSE2) байт за раз;
+/// вариант выбирается один раз по возможностям процессора, на прочих
+/// платформах работает побайтовый цикл.
+/// \return позиция найденного байта или size, если таких нет
+///
+size_t findEscape (const char* s, size_t size);
+
+///
+/// \brief scanKernel имя выбранного варианта: "avx2", "sse2" или "scalar"
+///
+const char* scanKernel ();
+
+#endif // SCAN_H
@@ -0,0 +1,171 @@
+#include "sink.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#include <unistd.h>
+
+JsonSink::JsonSink () : _begin (0), _pos (0), _end (0)
+{
+}
+
+JsonSink::~JsonSink ()
+{
+}
+
+void JsonSink::flush ()
+{
+}
+
+void JsonSink::writeSlow (const char* s, size_t size)
+{
+    while (size)
+    {
+        if (_pos == _end) overflow (1);
+        size_t n = (size_t)(_end - _pos);
+        if (n > size) n = size;
+        memcpy (_pos, s, n);
+        _pos += n;
+        s += n;
+        size -= n;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+JsonStringSink::JsonStringSink (std::string& s) : _s (s)
+{
+    size_t used = _s.size ();
+    setBuffer (&_s[0], &_s[0] + used, &_s[0] + used);
+}
+
+JsonStringSink::JsonStringSink (std::string& s, size_t expected) : _s (s)
+{
+    size_t used = _s.size ();
+    _s.resize (used + expected);
+    setBuffer (&_s[0], &_s[0] + used, &_s[0] + used + expected);
+}
+
+JsonStringSink::~JsonStringSink ()
+{
+    flush ();
+}
+
+void JsonStringSink::flush ()
+{
+    size_t used = (size_t)(_pos - _begin);
+    _s.resize (used);
+    // дальше писать можно только через overflow, который снова растит строку
+    setBuffer (&_s[0], &_s[0] + used, &_s[0] + used);
+}
+
+void JsonStringSink::overflow (size_t size)
+{
+    size_t used = (size_t)(_pos - _begin);
+    size_t capacity = _s.size () * 2;
+    if (capacity < used + size) capacity = used + size;
+    if (capacity < 256) capacity = 256;
+    _s.resize (capacity);
+    setBuffer (&_s[0], &_s[0] + used, &_s[0] + capacity);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+JsonBufferSink::JsonBufferSink (char* buffer, size_t size)
+    : _dropped (0), _overflowed (false)
+{
+    setBuffer (buffer, buffer, buffer + size);
+}
+
+size_t JsonBufferSink::size () const
+{
+    return _overflowed ? _dropped + (size_t)(_pos - _begin) : (size_t)(_pos - _begin);
+}
+
+bool JsonBufferSink::overflowed () const
+{
+    return _overflowed;
+}
+
+void JsonBufferSink::overflow (size_t)
+{
+    // всё, что не влезло, пишется в черновик и только подсчитывается
+    _dropped += (size_t)(_pos - _begin);
+    _overflowed = true;
+    setBuffer (_scratch, _scratch, _scratch + sizeof (_scratch));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+JsonFileSink::JsonFileSink (FILE* f, size_t bufferSize) : _f (f), _failed (false)
+{
+    if (bufferSize < MIN_BUFFER) bufferSize = MIN_BUFFER;
+    char* p = (char*)malloc (bufferSize);
+    if (p == 0) throw std::bad_alloc ();
+    setBuffer (p, p, p + bufferSize);
+}
+
+JsonFileSink::~JsonFileSink ()
+{
+    flush ();
+    free (_begin);
+}
+
+void JsonFileSink::flush ()
+{
+    size_t n = (size_t)(_pos - _begin);
+    if (n && !_failed && fwrite (_begin, 1, n, _f) != n) _failed = true;
+    _pos = _begin;
+}
+
+bool JsonFileSink::failed () const
+{
+    return _failed;
+}
+
+void JsonFileSink::overflow (size_t)
+{
+    flush ();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+JsonFdSink::JsonFdSink (int fd, size_t bufferSize) : _fd (fd), _failed (false)
+{
+    if (bufferSize < MIN_BUFFER) bufferSize = MIN_BUFFER;
+    char* p = (char*)malloc (bufferSize);
+    if (p == 0) throw std::bad_alloc ();
+    setBuffer (p, p, p + bufferSize);
+}
+
+JsonFdSink::~JsonFdSink ()
+{
+    flush ();
+    free (_begin);
+}
+
+void JsonFdSink::flush ()
+{
+    const char* p = _begin;
+    while (p != _pos && !_failed)
+    {
+        ssize_t r = ::write (_fd, p, (size_t)(_pos - p));
+        if (r < 0)
+        {
+            if (errno == EINTR) continue;
+            _failed = true;
+        }
+        else
+        {
+            p += r;
+        }
+    }
+    _pos = _begin;
+}
+
+bool JsonFdSink::failed () const
+{
+    return _failed;
+}
+
+void JsonFdSink::overflow (size_t)
+{
+    flush ();
+}
@@ -0,0 +1,165 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+///
+/// \brief JsonSink -- приёмник сериализованного текста.
+///
+/// Байты пишутся в буфер, который предоставляет наследник; когда буфер
+/// заполнен, вызывается overflow(), и наследник либо отдаёт накопленное
+/// (в файл, в дескриптор), либо расширяет буфер (строка). Каждый байт
+/// копируется ровно один раз, без промежуточных std::string.
+///
+class JsonSink
+{
+public:
+    virtual ~JsonSink ();
+
+    void put (char c)
+    {
+        if (_pos == _end) overflow (1);
+        *_pos++ = c;
+    }
+
+    void write (const char* s, size_t size)
+    {
+        if ((size_t)(_end - _pos) < size)
+        {
+            writeSlow (s, size);
+            return;
+        }
+        memcpy (_pos, s, size);
+        _pos += size;
+    }
+
+    void write (const std::string& s)
+    {
+        write (s.data (), s.size ());
+    }
+
+    /// отдаёт получателю всё накопленное в буфере
+    virtual void flush ();
+
+protected:
+    JsonSink ();
+
+    void setBuffer (char* begin, char* pos, char* end)
+    {
+        _begin = begin;
+        _pos = pos;
+        _end = end;
+    }
+
+    ///
+    /// \brief overflow освобождает в буфере место хотя бы под size байт
+    /// (size не больше MIN_BUFFER)
+    ///
+    virtual void overflow (size_t size) = 0;
+
+    enum { MIN_BUFFER = 64 };
+
+    char* _begin;
+    char* _pos;
+    char* _end;
+
+private:
+    JsonSink (const JsonSink&) = delete;
+    JsonSink& operator= (const JsonSink&) = delete;
+
+    void writeSlow (const char* s, size_t size);
+};
+
+///
+/// \brief JsonStringSink дописывает в std::string; буфером служит
+/// сама строка, поэтому лишнего копирования нет. Строка получает
+/// окончательный размер в flush() (и в деструкторе)
+///
+class JsonStringSink : public JsonSink
+{
+public:
+    explicit JsonStringSink (std::string& s);
+    /// expected -- сколько байт будет дописано (см. JsonValue::serializedSize):
+    /// строка растёт один раз, сразу на эту длину
+    JsonStringSink (std::string& s, size_t expected);
+    ~JsonStringSink ();
+
+    void flush ();
+
+protected:
+    void overflow (size_t size);
+
+private:
+    std::string& _s;
+};
+
+///
+/// \brief JsonBufferSink пишет в буфер фиксированного размера.
+/// Не поместившееся отбрасывается, но учитывается в size(),
+/// как у snprintf
+///
+class JsonBufferSink : public JsonSink
+{
+public:
+    JsonBufferSink (char* buffer, size_t size);
+
+    /// сколько байт было записано (или потребовалось бы записать)
+    size_t size () const;
+    /// true, если текст не поместился в буфер
+    bool overflowed () const;
+
+protected:
+    void overflow (size_t size);
+
+private:
+    size_t _dropped;
+    bool _overflowed;
+    char _scratch[MIN_BUFFER];
+};
+
+///
+/// \brief JsonFileSink пишет в FILE* через собственный буфер
+///
+class JsonFileSink : public JsonSink
+{
+public:
+    explicit JsonFileSink (FILE* f, size_t bufferSize = 65536);
+    ~JsonFileSink ();
+
+    void flush ();
+    /// true, если запись в файл не удалась
+    bool failed () const;
+
+protected:
+    void overflow (size_t size);
+
+private:
+    FILE* _f;
+    bool _failed;
+};
+
+///
+/// \brief JsonFdSink пишет в файловый дескриптор (write(2))
+///
+class JsonFdSink : public JsonSink
+{
+public:
+    explicit JsonFdSink (int fd, size_t bufferSize = 65536);
+    ~JsonFdSink ();
+
+    void flush ();
+    /// true, если запись в дескриптор не удалась
+    bool failed () const;
+
+protected:
+    void overflow (size_t size);
+
+private:
+    int _fd;
+    bool _failed;
+};
+
+#endif // SINK_H
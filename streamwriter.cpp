@@ -0,0 +1,402 @@
+#include "streamwriter.h"
+#include "writer.h"
+#include "scan.h"
+
+#include <cstring>
+
+JsonStreamWriter::JsonStreamWriter(JsonSink& out, bool sorted)
+    : _out(out), _sorted(sorted), _hasKey(false), _hasRoot(false)
+{
+}
+
+JsonStreamWriter::JsonStreamWriter(JsonSink& out,
+                                   const std::string& indent,
+                                   const std::string& indent0,
+                                   const std::string& indent1,
+                                   const std::string& eol,
+                                   bool sorted)
+    : _out(out), _indent(indent), _indent0(indent0), _indent1(indent1),
+      _eol(eol), _sorted(sorted), _hasKey(false), _hasRoot(false)
+{
+}
+
+/* разметка перед очередным значением: запятая и отступ в массиве
+   (в объекте их уже написал key) */
+bool JsonStreamWriter::next()
+{
+    if (_stack.empty())
+    {
+        if (_hasRoot) return false;
+        _hasRoot = true;
+        return true;
+    }
+
+    Level& level = _stack.back();
+    if (level.object)
+    {
+        if (!_hasKey) return false;
+        _hasKey = false;
+        return true;
+    }
+
+    JsonWriter<JsonSink> writer(_out, _indent, _indent0, _indent1, _eol, _sorted);
+    if (level.count++) writer.separator();
+    writer.indent(_stack.size() - 1);
+    return true;
+}
+
+bool JsonStreamWriter::begin(bool object)
+{
+    if (!next()) return false;
+
+    JsonWriter<JsonSink> writer(_out, _indent, _indent0, _indent1, _eol, _sorted);
+    writer.open(object ? '{' : '[');
+    Level level = { object, 0 };
+    _stack.push_back(level);
+    return true;
+}
+
+bool JsonStreamWriter::end(bool object)
+{
+    if (_stack.empty() || _stack.back().object != object || _hasKey)
+        return false;
+
+    _stack.pop_back();
+    JsonWriter<JsonSink> writer(_out, _indent, _indent0, _indent1, _eol, _sorted);
+    writer.close(_stack.size(), object ? '}' : ']');
+    return true;
+}
+
+bool JsonStreamWriter::beginArray()
+{
+    return begin(false);
+}
+
+bool JsonStreamWriter::beginObject()
+{
+    return begin(true);
+}
+
+bool JsonStreamWriter::endArray()
+{
+    return end(false);
+}
+
+bool JsonStreamWriter::endObject()
+{
+    return end(true);
+}
+
+bool JsonStreamWriter::key(const std::string& k)
+{
+    return key(k.data(), k.size());
+}
+
+bool JsonStreamWriter::key(const char* k, size_t size)
+{
+    if (!inObject() || _hasKey) return false;
+
+    JsonWriter<JsonSink> writer(_out, _indent, _indent0, _indent1, _eol, _sorted);
+    if (_stack.back().count++) writer.separator();
+    writer.indent(_stack.size() - 1);
+    writer.writeString(k, size);
+    _out.put(':');
+    _hasKey = true;
+    return true;
+}
+
+bool JsonStreamWriter::value(const JsonValue& v)
+{
+    if (!next()) return false;
+
+    JsonWriter<JsonSink> writer(_out, _indent, _indent0, _indent1, _eol, _sorted);
+    writer.write(v, _stack.size());
+    return true;
+}
+
+bool JsonStreamWriter::value(const char* s, size_t size)
+{
+    if (!next()) return false;
+
+    JsonWriter<JsonSink> writer(_out, _indent, _indent0, _indent1, _eol, _sorted);
+    writer.writeString(s, size);
+    return true;
+}
+
+size_t JsonStreamWriter::depth() const
+{
+    return _stack.size();
+}
+
+bool JsonStreamWriter::inArray() const
+{
+    return !_stack.empty() && !_stack.back().object;
+}
+
+bool JsonStreamWriter::inObject() const
+{
+    return !_stack.empty() && _stack.back().object;
+}
+
+bool JsonStreamWriter::done() const
+{
+    return _hasRoot && _stack.empty();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+namespace
+{
+
+inline const char* skipSpace(const char* p, const char* end)
+{
+    while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    return p;
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* конец строки, открытой кавычкой в p[-1], -- позиция закрывающей
+   кавычки или 0, если строка не закрыта или содержит управляющие символы */
+const char* stringEnd(const char* p, const char* end)
+{
+    for (;;)
+    {
+        p += findEscape(p, (size_t)(end - p));
+        if (p == end) return 0;
+        switch (*p)
+        {
+        case '\"' :
+            return p;
+        case '\\' :
+            if (end - p < 2) return 0;
+            p += 2;
+            break;
+        case '/' :
+            ++p;
+            break;
+        default:
+            return 0;
+        }
+    }
+}
+
+/* конец числа -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? или 0 */
+const char* numberEnd(const char* p, const char* end)
+{
+    if (p != end && *p == '-') ++p;
+    if (p == end || !isDigit(*p)) return 0;
+    if (*p++ != '0') while (p != end && isDigit(*p)) ++p;
+    if (p != end && *p == '.')
+    {
+        if (++p == end || !isDigit(*p)) return 0;
+        while (p != end && isDigit(*p)) ++p;
+    }
+    if (p != end && (*p == 'e' || *p == 'E'))
+    {
+        if (++p != end && (*p == '+' || *p == '-')) ++p;
+        if (p == end || !isDigit(*p)) return 0;
+        while (p != end && isDigit(*p)) ++p;
+    }
+    return p;
+}
+
+inline const char* literalEnd(const char* p, const char* end, const char* word, size_t size)
+{
+    return (size_t)(end - p) >= size && memcmp(p, word, size) == 0 ? p + size : 0;
+}
+
+/*
+ * Разбор текста одним проходом. О том, что встретилось, узнаёт Emit:
+ * скобки (open/close), запятые (separator), место перед элементом
+ * (indent), двоеточие (colon), лексемы (token) и пропущенные пробелы
+ * (space). Память -- только на стек открытых контейнеров
+ */
+template <class Emit>
+bool transcode(const char* p, const char* end, Emit& emit)
+{
+    // открытые контейнеры: '{' или '['
+    std::vector<char> stack;
+    // что ждём дальше: значение, ключ объекта или запятую/скобку после значения
+    enum { VALUE, KEY, NEXT } state = VALUE;
+
+    for (;;)
+    {
+        const char* e = skipSpace(p, end);
+        if (e != p) emit.space(p, e);
+        p = e;
+
+        switch (state)
+        {
+        case VALUE :
+            if (p == end) return false;
+            switch (*p)
+            {
+            case '{' :
+            case '[' :
+            {
+                char bracket = *p++;
+                char pair = bracket == '{' ? '}' : ']';
+                emit.open(bracket);
+                stack.push_back(bracket);
+
+                e = skipSpace(p, end);
+                if (e != p) emit.space(p, e);
+                p = e;
+                if (p != end && *p == pair)
+                {
+                    ++p;
+                    stack.pop_back();
+                    emit.close(stack.size(), pair);
+                    state = NEXT;
+                }
+                else if (bracket == '{')
+                {
+                    state = KEY;
+                }
+                else
+                {
+                    emit.indent(stack.size() - 1);
+                }
+                continue;
+            }
+
+            case '\"' :
+                e = stringEnd(p + 1, end);
+                if (e) ++e;
+                break;
+
+            case 't' : e = literalEnd(p, end, "true", 4); break;
+            case 'f' : e = literalEnd(p, end, "false", 5); break;
+            case 'n' : e = literalEnd(p, end, "null", 4); break;
+            default  : e = numberEnd(p, end); break;
+            }
+            if (e == 0) return false;
+            emit.token(p, e);
+            p = e;
+            state = NEXT;
+            break;
+
+        case KEY :
+            if (p == end || *p != '\"') return false;
+            e = stringEnd(p + 1, end);
+            if (e == 0) return false;
+            emit.indent(stack.size() - 1);
+            emit.token(p, ++e);
+            p = e;
+            e = skipSpace(p, end);
+            if (e != p) emit.space(p, e);
+            p = e;
+            if (p == end || *p != ':') return false;
+            ++p;
+            emit.colon();
+            state = VALUE;
+            break;
+
+        case NEXT :
+            if (stack.empty())
+            {
+                emit.finish(p);
+                return p == end;
+            }
+            if (p == end) return false;
+            if (*p == (stack.back() == '{' ? '}' : ']'))
+            {
+                stack.pop_back();
+                emit.close(stack.size(), *p++);
+                break;
+            }
+            if (*p++ != ',') return false;
+            emit.separator();
+            if (stack.back() == '{')
+            {
+                state = KEY;
+            }
+            else
+            {
+                emit.indent(stack.size() - 1);
+                state = VALUE;
+            }
+            break;
+        }
+    }
+}
+
+/* разметку между лексемами пишет тот же JsonWriter, что и у prettyStringify */
+class PrettyEmit
+{
+public:
+    PrettyEmit(JsonSink& out, const std::string& indent,
+               const std::string& indent0, const std::string& indent1,
+               const std::string& eol)
+        : _out(out), _writer(out, indent, indent0, indent1, eol, false)
+    {
+    }
+
+    void open(char bracket) { _writer.open(bracket); }
+    void close(size_t depth, char bracket) { _writer.close(depth, bracket); }
+    void separator() { _writer.separator(); }
+    void indent(size_t depth) { _writer.indent(depth); }
+    void colon() { _out.put(':'); }
+    void token(const char* p, const char* e) { _out.write(p, (size_t)(e - p)); }
+    void space(const char*, const char*) {}
+    void finish(const char*) {}
+
+private:
+    JsonSink& _out;
+    JsonWriter<JsonSink> _writer;
+};
+
+/* компактный текст -- это исходный без пробелов между лексемами:
+   он копируется целыми кусками от пробела до пробела */
+class CompactEmit
+{
+public:
+    CompactEmit(JsonSink& out, const char* json) : _out(out), _span(json) {}
+
+    void open(char) {}
+    void close(size_t, char) {}
+    void separator() {}
+    void indent(size_t) {}
+    void colon() {}
+    void token(const char*, const char*) {}
+
+    void space(const char* p, const char* e)
+    {
+        _out.write(_span, (size_t)(p - _span));
+        _span = e;
+    }
+
+    void finish(const char* p)
+    {
+        _out.write(_span, (size_t)(p - _span));
+        _span = p;
+    }
+
+private:
+    JsonSink& _out;
+    const char* _span;
+};
+
+} // namespace
+
+bool reformat(JsonSink& out, const char* json, size_t size,
+              const std::string& indent,
+              const std::string& indent0,
+              const std::string& indent1,
+              const std::string& eol)
+{
+    if (indent.empty() && indent0.empty() && indent1.empty() && eol.empty())
+        return minify(out, json, size);
+
+    PrettyEmit emit(out, indent, indent0, indent1, eol);
+    return transcode(json, json + size, emit);
+}
+
+bool minify(JsonSink& out, const char* json, size_t size)
+{
+    CompactEmit emit(out, json);
+    return transcode(json, json + size, emit);
+}
@@ -0,0 +1,99 @@
+#ifndef STREAMWRITER_H
+#define STREAMWRITER_H
+
+#include "value.h"
+#include "sink.h"
+
+#include <string>
+#include <vector>
+
+///
+/// \brief JsonStreamWriter пишет документ по событиям
+/// (beginObject/key/value/endObject ...) прямо в JsonSink, не строя
+/// дерево: памяти нужно только на стек открытых контейнеров.
+///
+/// value принимает и целые поддеревья JsonValue. Разметка, экранирование
+/// и числа -- те же, что у stringify/prettyStringify, так что события,
+/// повторяющие обход дерева, дают побайтно тот же текст.
+///
+/// Как и у JsonBuilder, методы возвращают false при нарушении порядка
+/// вызовов; в приёмник тогда ничего не пишется.
+///
+class JsonStreamWriter
+{
+public:
+    /// компактный вывод, как stringify
+    explicit JsonStreamWriter(JsonSink& out, bool sorted = false);
+    /// вывод с отступами, как prettyStringify с теми же параметрами
+    /// (без умолчаний: строковый литерал иначе ушёл бы в bool sorted)
+    JsonStreamWriter(JsonSink& out,
+                     const std::string& indent,
+                     const std::string& indent0,
+                     const std::string& indent1,
+                     const std::string& eol,
+                     bool sorted = false);
+
+    bool beginArray();
+    bool beginObject();
+    bool endArray();
+    bool endObject();
+
+    bool key(const std::string& k);
+    bool key(const char* k, size_t size);
+
+    /// sorted упорядочивает члены объектов внутри v; ключи, заданные
+    /// через key, идут в порядке вызовов
+    bool value(const JsonValue& v);
+    /// строка без промежуточного JsonValue
+    bool value(const char* s, size_t size);
+
+    /// глубина вложенности открытых контейнеров
+    size_t depth() const;
+    bool inArray() const;
+    bool inObject() const;
+
+    /// документ записан полностью: корень задан и все контейнеры закрыты
+    bool done() const;
+
+private:
+    bool next();
+    bool begin(bool object);
+    bool end(bool object);
+
+    // по открытому контейнеру: объект ли он и сколько в нём элементов
+    struct Level
+    {
+        bool object;
+        size_t count;
+    };
+
+    JsonSink& _out;
+    std::string _indent;
+    std::string _indent0;
+    std::string _indent1;
+    std::string _eol;
+    bool _sorted;
+    std::vector<Level> _stack;
+    bool _hasKey;
+    bool _hasRoot;
+};
+
+///
+/// \brief reformat переписывает JSON-текст json[0..size) с отступами,
+/// как prettyStringify с теми же параметрами, не строя дерево.
+/// Строки и числа переносятся как есть, байт в байт (включая
+/// escape-последовательности и запись вроде 1.0 или 1E5), повторные
+/// ключи сохраняются.
+/// \return false, если текст не является JSON; в out к этому моменту
+/// уже записано начало
+///
+bool reformat(JsonSink& out, const char* json, size_t size,
+              const std::string& indent = "  ",
+              const std::string& indent0 = "",
+              const std::string& indent1 = "  ",
+              const std::string& eol = "\n");
+
+/// то же без пробелов и переводов строк
+bool minify(JsonSink& out, const char* json, size_t size);
+
+#endif // STREAMWRITER_H
@@ -1,98 +1,202 @@
 #include "stringutils.h"
-#include <float.h> // DBL_MAX
-#include <math.h> // modf
+#include "sink.h"
+#include "dtoa.h"
+#include "scan.h"
+#include "3rdparty/utf8/utf8.h"
+#include <stdint.h> // uint32_t
+#include <string.h> // memcpy
 
-char* get_buf(size_t sz)
+size_t formatNumber (char* buf, double d)
 {
-    static size_t buf_size = 1024;
-    static char* buf = (char*) malloc(buf_size);
-    
-    if(sz > buf_size)
+    if ((d * 0) != 0)
     {
-        buf_size = sz * 1.5;
-        buf = (char*) realloc(buf, buf_size);
+        memcpy (buf, "null", 4);
+        return 4;
     }
-    return buf;
+    return formatShortest (buf, d);
+}
+
+size_t formatNumber (char* buf, long long v)
+{
+    static const char digits[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // LLONG_MIN не имеет положительной пары, поэтому модуль -- беззнаковый
+    unsigned long long u = v < 0 ? 0ull - (unsigned long long)v : (unsigned long long)v;
+    char tmp[24];
+    char* p = tmp + sizeof (tmp);
+    while (u >= 100)
+    {
+        unsigned d = (unsigned)(u % 100) * 2;
+        u /= 100;
+        *--p = digits[d + 1];
+        *--p = digits[d];
+    }
+    if (u >= 10)
+    {
+        unsigned d = (unsigned)u * 2;
+        *--p = digits[d + 1];
+        *--p = digits[d];
+    }
+    else
+    {
+        *--p = (char)('0' + u);
+    }
+    if (v < 0) *--p = '-';
+
+    size_t n = (size_t)(tmp + sizeof (tmp) - p);
+    memcpy (buf, p, n);
+    return n;
 }
 
 std::string numberToString (double d)
 {
     char buf[64];
-    int buffer_size = 64;
-    int printedChars = 0;
-    
-    double absd = d < 0 ? -d: d;
-    double delta = (int64_t)(d) - d;
-    double absDelta = delta < 0 ? -delta : delta;
-    if ((d * 0) != 0) {
-        printedChars = snprintf(buf, buffer_size, "null");
-    } else if ((absDelta <= DBL_EPSILON) && (absd < 1.0e60)) {
-        printedChars = snprintf(buf, buffer_size, "%.1f", d);
-    } else if ((absd < 1.0e-6) || (absd > 1.0e9)) {
-        printedChars = snprintf(buf, buffer_size, "%e", d);
-    } else {
-        printedChars = snprintf(buf, buffer_size, "%f", d);
-        if (printedChars < buffer_size) {
-            while (buf[printedChars - 1] == '0') {
-                printedChars--;
-            }
-        }
-    }
-    return std::string (buf, buf + printedChars);
+    return std::string (buf, formatNumber (buf, d));
 }
 
 std::string numberToString (long long v)
 {
-    static char buf[64];
-    int printedChars = snprintf (buf, 63, "%lld", v);
-    return std::string (buf, buf + printedChars);
+    char buf[64];
+    return std::string (buf, formatNumber (buf, v));
 }
 
-void escape (char *dst, const char* src)
+void escape (JsonSink& out, const char* src, size_t size, bool escapeSlash)
 {
-    char c;
-    while ((c = *src++))
+    static const char hex[] = "0123456789abcdef";
+
+    for (;;)
     {
+        // неизменные участки находит findEscape и они уходят в приёмник целиком
+        size_t n = findEscape (src, size);
+        out.write (src, n);
+        if (n == size) break;
+
+        unsigned char c = (unsigned char)src[n];
+        src += n + 1;
+        size -= n + 1;
+
+        char e;
         switch (c)
         {
-        case '\"' :
-            *dst++ = '\\';
-            *dst++ = '\"';
-            break;
-        case '\\' :
-            *dst++ = '\\';
-            *dst++ = '\\';
-            break;
+        case '\"' : e = '\"'; break;
+        case '\\' : e = '\\'; break;
+        case '\b' : e = 'b'; break;
+        case '\f' : e = 'f'; break;
+        case '\n' : e = 'n'; break;
+        case '\r' : e = 'r'; break;
+        case '\t' : e = 't'; break;
         case '/'  :
-            *dst++ = '\\';
-            *dst++ = '/';
-            break;
-        case '\b' :
-            *dst++ = '\\';
-            *dst++ = 'b';
-            break;
-        case '\f' :
-            *dst++ = '\\';
-            *dst++ = 'f';
-            break;
-        case '\n' :
-            *dst++ = '\\';
-            *dst++ = 'n';
-            break;
-        case '\r' :
-            *dst++ = '\\';
-            *dst++ = 'r';
-            break;
-        case '\t' :
-            *dst++ = '\\';
-            *dst++ = 't';
+            if (!escapeSlash)
+            {
+                out.put ('/');
+                continue;
+            }
+            e = '/';
             break;
         default:
-            *dst++ = c;
+        {
+            // прочие управляющие символы, включая NUL, -- \u00XX
+            char u[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+            out.write (u, sizeof (u));
+            continue;
+        }
+        }
+        out.put ('\\');
+        out.put (e);
+    }
+}
+
+size_t escapedSize (const char* src, size_t size, bool escapeSlash)
+{
+    size_t res = size;
+    for (;;)
+    {
+        size_t n = findEscape (src, size);
+        if (n == size) break;
+
+        unsigned char c = (unsigned char)src[n];
+        src += n + 1;
+        size -= n + 1;
+
+        if (c == '/') res += escapeSlash ? 1 : 0;
+        else if (c == '\"' || c == '\\' || c == '\b' || c == '\f' ||
+                 c == '\n' || c == '\r' || c == '\t') res += 1;
+        else res += 5;
+    }
+    return res;
+}
+
+namespace
+{
+// сколько байт за '\\' может прочесть u8_read_escape_sequence:
+// \UXXXXXXXX и ещё один, на котором он проверяет конец цифр
+const ptrdiff_t ESCAPE_MAX = 10;
+}
+
+size_t unescape (char* dst, const char* src, size_t size)
+{
+    const char* end = src + size;
+    char* out = dst;
+
+    // старший суррогат UTF-16 и место, куда он записан: если сразу за ним
+    // идёт младший, пара заменяется одним символом
+    uint32_t high = 0;
+    char* highPos = 0;
+
+    while (src < end)
+    {
+        const char* bs = (const char*)memchr (src, '\\', (size_t)(end - src));
+        if (bs == 0) bs = end;
+        if (bs != src)
+        {
+            memcpy (out, src, (size_t)(bs - src));
+            out += bs - src;
+            src = bs;
+            high = 0;
+            if (src == end) break;
+        }
+
+        if (end - src == 1)
+        {
+            // одинокий '\\' в конце переносится как есть
+            *out++ = '\\';
             break;
         }
+
+        // u8_read_escape_sequence останавливается только на не-цифре:
+        // у конца буфера ему отдаётся копия хвоста с нулём
+        uint32_t ch;
+        if (end - src > ESCAPE_MAX)
+        {
+            src += 1 + u8_read_escape_sequence (src + 1, &ch);
+        }
+        else
+        {
+            char tail[ESCAPE_MAX + 1] = {};
+            memcpy (tail, src + 1, (size_t)(end - src - 1));
+            src += 1 + u8_read_escape_sequence (tail, &ch);
+        }
+        if (high && (ch & 0xFC00) == 0xDC00)
+        {
+            ch = (((high & 0x3FF) << 10) | (ch & 0x3FF)) + 0x10000;
+            out = highPos;
+            high = 0;
+        }
+        else if ((ch & 0xFC00) == 0xD800)
+        {
+            high = ch;
+            highPos = out;
+        }
+        else
+        {
+            high = 0;
+        }
+        out += u8_wc_toutf8 (out, ch);
     }
-    *dst = 0;
+    return (size_t)(out - dst);
 }
 
 void
@@ -134,16 +238,9 @@ ssplit ( const std::string  & theString,
 std::string escapedString (const std::string& s)
 {
     std::string es;
-
-    const char* src = s.c_str ();
-    size_t sz = strlen (src) * 2;
-
-    char* dst = get_buf(sz + 1);
-    if (dst)
-    {
-        escape (dst, src);
-        es = dst;
-    }
+    JsonStringSink out (es);
+    escape (out, s.data (), s.size ());
+    out.flush ();
     return es;
 }
 
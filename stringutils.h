@@ -5,13 +5,19 @@
 #include <vector>
 #include <sstream>
 
-char* get_buf(size_t sz);
-
 /////
 /////
 /////
 std::string numberToString (double v);
 std::string numberToString (long long v);
+///
+/// \brief formatNumber печатает число в buf (не меньше 64 байт).
+/// double печатается кратчайшей строкой, которая разбирается обратно
+/// в то же значение (см. formatShortest); NaN и бесконечности -- "null"
+/// \return число записанных символов
+///
+size_t formatNumber (char* buf, double v);
+size_t formatNumber (char* buf, long long v);
 
 ///
 ///
@@ -29,12 +35,33 @@ std::string merge(InputIt first, InputIt last,
     return s.str();
 }
 ///
-/// \brief escapedString
-/// \param s
-/// \return
+/// \brief escapedString возвращает экранированную копию s целиком,
+/// включая символы после встроенных NUL
 ///
 std::string escapedString (const std::string& s);
 ///
+/// \brief escape пишет экранированную строку прямо в приёмник.
+/// Длина задаётся size, NUL экранируется как \u0000; ни буферов,
+/// ни общего состояния нет, так что вызов безопасен из любого потока.
+/// escapeSlash = false оставляет '/' как есть (каноническая форма)
+///
+class JsonSink;
+void escape (JsonSink& out, const char* src, size_t size, bool escapeSlash = true);
+///
+/// \brief escapedSize длина, которую escape выдаст для той же строки;
+/// сама строка не копируется
+///
+size_t escapedSize (const char* src, size_t size, bool escapeSlash = true);
+///
+/// \brief unescape раскодирует escape-последовательности JSON-строки
+/// (\n, \uXXXX, суррогатные пары UTF-16) из src в dst.
+/// Участки без '\\' копируются целиком. Результат не длиннее size;
+/// за src + size чтение не выходит: обрезанная последовательность
+/// раскодируется из того, что есть, одинокий '\\' в конце копируется
+/// \return длина результата
+///
+size_t unescape (char* dst, const char* src, size_t size);
+///
 /// \brief ssplit
 /// \param theStringVector
 /// \param theString
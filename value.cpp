@@ -1,12 +1,32 @@
 #include "value.h"
+#include "builder.h"
 #include "3rdparty/jsmn/jsmn.h"
-#include "3rdparty/utf8/utf8.h"
 #include "stringutils.h"
+#include "atod.h"
+#include "dtoa.h"
+#include "scan.h"
+#include "writer.h"
 
 #include <string>
 #include <cfloat> /* DBL_MAX */
 #include <vector>
 #include <cstdlib> /* malloc */
+#include <cstring> /* strcmp */
+#include <algorithm> /* sort */
+#include <cstddef> /* offsetof */
+#include <new>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*---------------------------------------------------------------------------*/
 /*  Implementation.                */
@@ -40,181 +60,377 @@ KeyValue::KeyValue(JsonValue& v) : value(v)
 //////////////////////////////////////////////////////////////////////////////
 const JsonValue JsonValue::_dummyValue;
 
-JsonValue::JsonValue(Type type) : _type(type), _parent(0)
+// _value обнуляется: пустое значение переносят перемещением (insert
+// ставит на место JsonValue ()), и копировать мусор незачем
+JsonValue::JsonValue(Type type) : _value ()
 {
-    switch (_type)
+    switch (type)
     {
     case OBJECT:
-        _value._o = new ObjectContainer ();
-        break;
-
     case ARRAY:
-        _value._a = new ArrayContainer ();
+        setContainer (type, 0);
         break;
 
     case STRING:
-        _value._s = new std::string ();
+        setString ("", 0, 0);
         break;
 
     default:
+        setType (type);
         break;
     }
 }
 
-JsonValue::JsonValue(bool v) : _type(BOOLEAN), _parent(0)
+JsonValue::JsonValue(bool v)
 {
+    setType (BOOLEAN);
     _value._l = v;
 }
 
-JsonValue::JsonValue(int v) : _type(INTEGER), _parent(0)
+JsonValue::JsonValue(int v)
 {
+    setType (INTEGER);
     _value._i = (long long)v;
 }
 
-JsonValue::JsonValue(long v) : _type(INTEGER), _parent(0)
+JsonValue::JsonValue(long v)
 {
+    setType (INTEGER);
     _value._i = (long long)v;
 }
 
-JsonValue::JsonValue(long long v) : _type(INTEGER), _parent(0)
+JsonValue::JsonValue(long long v)
 {
+    setType (INTEGER);
     _value._i = v;
 }
 
-JsonValue::JsonValue(size_t v) : _type(INTEGER), _parent(0)
+JsonValue::JsonValue(size_t v)
 {
+    setType (INTEGER);
     _value._i = (long long)v;
 }
 
-JsonValue::JsonValue(double v) : _type(NUMBER), _parent(0)
+JsonValue::JsonValue(double v)
 {
+    setType (NUMBER);
     _value._d = v;
 }
 
-JsonValue::JsonValue(const char* v) : _type(STRING), _parent(0)
+JsonValue::JsonValue(const char* v)
 {
-    _value._s = new std::string (v);
+    setString (v, strlen (v), 0);
 }
 
-JsonValue::JsonValue(const std::string& v) : _type(STRING), _parent(0)
+JsonValue::JsonValue(const std::string& v)
 {
-    _value._s = new std::string (v);
+    setString (v.data (), v.size (), 0);
 }
 
-JsonValue::JsonValue(std::string&& v) : _type(STRING), _parent(0)
+JsonValue::JsonValue(std::string&& v)
 {
-    _value._s = new std::string ();
-    std::swap (*(std::string*)_value._s, v);
+    setString (v.data (), v.size (), 0);
 }
 
 /* ХИТРЫЙ КОНСТРУКТОР для объектов, прочитанных из потока */
-JsonValue::JsonValue (char* buffer, size_t size, bool itIsString)
-: _type(UNDEFINED), _parent(0)
+JsonValue::JsonValue (const char* buffer, size_t size, bool itIsString)
 {
-    double d = 0;
-    long long l = 0;
-    char *p = 0;
-    char lc = *(buffer + size);
-    *(buffer + size) = 0;
-    
-    if (itIsString) goto parse_string;
-    
-    if (l = strtoll(buffer, &p, 10), (*p == 0)) /* ЦЕЛОЕ ЧИСЛО ... */
+    setToken (buffer, size, itIsString, 0);
+}
+
+/* лексема совпадает со словом целиком, без завершающего нуля */
+static inline bool isWord (const char* buffer, size_t size, const char* word, size_t n)
+{
+    return size == n && memcmp (buffer, word, n) == 0;
+}
+
+/*
+ * Буфер только читается (см. parse). Вид лексемы определяется по первому
+ * байту: литералы сравниваются по длине, числа разбирает parseNumber
+ */
+void JsonValue::setToken (const char* buffer, size_t size, bool itIsString,
+                          JsonArena* arena)
+{
+    if (!itIsString)
     {
-        _type     = INTEGER;
-        _value._i = l;
+        long long l = 0;
+        double d = 0;
+
+        switch (size ? buffer[0] : 0)
+        {
+        case 't':
+            if (isWord (buffer, size, "true", 4))
+            {
+                setType (BOOLEAN);
+                _value._l = true;
+                return;
+            }
+            break;
+        case 'f':
+            if (isWord (buffer, size, "false", 5))
+            {
+                setType (BOOLEAN);
+                _value._l = false;
+                return;
+            }
+            break;
+        case 'n':
+            if (isWord (buffer, size, "null", 4)) return;
+            break;
+        }
+
+        switch (parseNumber (buffer, size, l, d))
+        {
+        case INTEGER_NUMBER: /* ЦЕЛОЕ ЧИСЛО ... */
+            setType (INTEGER);
+            _value._i = l;
+            return;
+        case FLOAT_NUMBER: /* ЧИСЛО С ПЛАВАЮЩЕЙ ... */
+            setType (NUMBER);
+            _value._d = d;
+            return;
+        case NOT_A_NUMBER:
+            break;
+        }
     }
-    else if (d = strtod(buffer, &p), (*p == 0)) /* ЧИСЛО С ПЛАВАЮЩЕЙ ... */
+
+    // раскодированная строка не длиннее исходной
+    setString (buffer, size, arena);
+    const char* bs = (const char*)memchr (buffer, '\\', size);
+    if (bs)
     {
-        _type     = NUMBER;
-        _value._d = d;
+        // начало до первого '\\' уже скопировано как есть
+        size_t k = (size_t)(bs - buffer);
+        char* ps = (flags () & INLINE_STRING) ? _value._c : _value._s->data;
+        size_t r = k + unescape (ps + k, bs, size - k);
+        ps[r] = 0;
+        setStringSize (r);
     }
-    else if (strcmp(buffer, "true") == 0)
+}
+
+void JsonValue::setString (const char* s, size_t size, JsonArena* arena)
+{
+    setType (STRING);
+
+    // короткая строка целиком помещается в сам узел
+    if (size <= INLINE_CAPACITY)
     {
-        _type     = BOOLEAN;
-        _value._l = true;
+        memcpy (_value._c, s, size);
+        _value._c[size] = 0;
+        setFlags (INLINE_STRING);
+        setStringSize (size);
+        return;
     }
-    else if (strcmp(buffer, "false") == 0)
+
+    size_t bytes = offsetof (StringData, data) + size + 1;
+    StringData* sd = (StringData*)(arena ? arena->allocate (bytes, alignof (StringData))
+                                          : malloc (bytes));
+    if (sd == 0) throw std::bad_alloc ();
+    sd->size = size;
+    memcpy (sd->data, s, size);
+    sd->data[size] = 0;
+
+    setFlags (arena ? ARENA_STORAGE : 0);
+    _value._s = sd;
+}
+
+void JsonValue::setContainer (Type type, JsonArena* arena)
+{
+    if (arena)
     {
-        _type     = BOOLEAN;
-        _value._l = false;
+        if (type == OBJECT)
+        {
+            ObjectContainer* o = new (arena->allocate (sizeof (ObjectContainer),
+                                      alignof (ObjectContainer))) ObjectContainer (arena);
+            // ключи длиннее встроенного буфера std::string живут в куче,
+            // поэтому объекту арены нужен деструктор при её освобождении
+            arena->onRelease ([](void* p) { ((ObjectContainer*)p)->~ObjectContainer (); }, o);
+            _value._o = o;
+        }
+        else
+        {
+            _value._a = new (arena->allocate (sizeof (ArrayContainer),
+                             alignof (ArrayContainer))) ArrayContainer (arena);
+        }
+        setFlags (ARENA_STORAGE);
     }
-    else if (strcmp(buffer, "null") == 0)
+    else
     {
+        if (type == OBJECT)
+            _value._o = new ObjectContainer ();
+        else
+            _value._a = new ArrayContainer ();
+        setFlags (0);
     }
-    else
+    setType (type);
+}
+
+/* глубокая копия v в этот (уже сброшенный) узел с памятью из arena */
+void JsonValue::copyFrom (const JsonValue& v, JsonArena* arena)
+{
+    switch (v.type ())
+    {
+    case OBJECT:
+        if (arena == 0)
+        {
+            _value._o = new ObjectContainer (*v._value._o);
+            setType (OBJECT);
+            setFlags (0);
+        }
+        else
+        {
+            setContainer (OBJECT, arena);
+            for (const auto& p : *v._value._o)
+            {
+                JsonValue& rv = (*_value._o)[p.first];
+                rv.setParent (this);
+                rv.copyFrom (p.second, arena);
+            }
+        }
+        adoptChildren ();
+        break;
+
+    case ARRAY:
+        if (arena == 0)
+        {
+            _value._a = new ArrayContainer (*v._value._a);
+            setType (ARRAY);
+            setFlags (0);
+        }
+        else
+        {
+            setContainer (ARRAY, arena);
+            for (const auto& a : *v._value._a)
+            {
+                _value._a->emplace_back ().copyFrom (a, arena);
+            }
+        }
+        adoptChildren ();
+        break;
+
+    case STRING:
+        setString (v.stringData (), v.stringSize (), arena);
+        break;
+
+    default:
+        setType (v.type ());
+        _value = v._value;
+        break;
+    }
+}
+
+/*
+ * Память для нового содержимого узла берётся оттуда же, откуда
+ * контейнер-владелец берёт память под свои элементы: узлы документа
+ * в арене не должны владеть памятью из кучи, иначе её некому освободить.
+ */
+JsonArena* JsonValue::storageArena () const
+{
+    if (parent () == 0) return 0;
+    switch (parent ()->type ())
     {
-    parse_string:
-        _type = STRING;
-        _value._s = new std::string(buffer, size);
-        std::string& ps = *(_value._s);
-        size_t r = (size_t)u8_unescape(&ps[0], (int)size, ps.c_str());
-        ps.resize(r);
+    case OBJECT:
+        return parent ()->_value._o->arena ();
+    case ARRAY:
+        return parent ()->_value._a->arena ();
+    default:
+        return 0;
     }
-    *(buffer + size) = lc;
 }
 
-JsonValue::Type JsonValue::type() const
+/*
+ * Длина встроенной строки хранится в последнем байте буфера как
+ * INLINE_CAPACITY - size: у строки предельной длины этот байт
+ * становится нулём и служит ей терминатором.
+ */
+const char* JsonValue::stringData () const
+{
+    return (flags () & INLINE_STRING) ? _value._c : _value._s->data;
+}
+
+size_t JsonValue::stringSize () const
 {
-    return _type;
+    if (flags () & INLINE_STRING)
+        return INLINE_CAPACITY - (unsigned char)_value._c[INLINE_CAPACITY];
+    return _value._s->size;
+}
+
+void JsonValue::setStringSize (size_t size)
+{
+    if (flags () & INLINE_STRING)
+    {
+        _value._c[size] = 0;
+        _value._c[INLINE_CAPACITY] = (char)(INLINE_CAPACITY - size);
+    }
+    else
+    {
+        _value._s->data[size] = 0;
+        _value._s->size = size;
+    }
 }
 
 bool JsonValue::isUndefined() const
 {
-    return _type == UNDEFINED;
+    return type () == UNDEFINED;
 }
 
 bool JsonValue::isBoolean() const
 {
-    return _type == BOOLEAN;
+    return type () == BOOLEAN;
 }
 
 bool JsonValue::isNumber() const
 {
-    return _type == NUMBER || _type == INTEGER;
+    return type () == NUMBER || type () == INTEGER;
 }
 
 bool JsonValue::isInteger() const
 {
-    return _type == INTEGER;
+    return type () == INTEGER;
 }
 
 bool JsonValue::isString() const
 {
-    return _type == STRING;
+    return type () == STRING;
 }
 
 bool JsonValue::isArray() const
 {
-    return _type == ARRAY;
+    return type () == ARRAY;
 }
 
 bool JsonValue::isObject() const
 {
-    return _type == OBJECT;
+    return type () == OBJECT;
 }
 
 void JsonValue::reset ()
 {
-    switch (_type)
+    // память из арены освобождается только вместе с ареной,
+    // а встроенной строке освобождать нечего
+    if ((flags () & (ARENA_STORAGE | INLINE_STRING)) == 0)
     {
-    case OBJECT:
-        delete _value._o;
-        break;
+        switch (type ())
+        {
+        case OBJECT:
+            delete _value._o;
+            break;
 
-    case ARRAY:
-        delete _value._a;
-        break;
+        case ARRAY:
+            delete _value._a;
+            break;
 
-    case STRING:
-        delete _value._s;
-        break;
+        case STRING:
+            free (_value._s);
+            break;
 
-    default:
-        break;
+        default:
+            break;
+        }
     }
 
-    _type = UNDEFINED;
+    setType (UNDEFINED);
+    setFlags (0);
     _value = _Value();
 
 }
@@ -244,81 +460,39 @@ JsonValue::~JsonValue ()
     reset ();
 }
 
-JsonValue::JsonValue(const JsonValue& v) : _type(v._type), _parent(0)
+JsonValue::JsonValue(const JsonValue& v)
 {
-    switch (_type)
-    {
-    case OBJECT:
-        _value._o = new ObjectContainer (*v._value._o);
-        for (auto& p : *_value._o) p.second._parent = this;
-        break;
-
-    case ARRAY:
-        _value._a = new ArrayContainer (*v._value._a);
-        for (auto& rv : * (_value._a)) rv._parent = this;
-        break;
-
-    case STRING:
-        _value._s = new std::string (*v._value._s);
-        break;
-
-    default:
-        _value = v._value;
-        break;
-    }
+    copyFrom (v, 0);
 }
 
-JsonValue::JsonValue (JsonValue&& v) : _type(v._type), _value(v._value),
-    _parent(0)
+JsonValue::JsonValue (JsonValue&& v) : _value(v._value)
 {
-    switch (_type)
-    {
-    case OBJECT:
-        for (auto& p : *_value._o) p.second._parent = this;
-        break;
-
-    case ARRAY:
-        for (auto& rv : * (_value._a)) rv._parent = this;
-        break;
-
-    default:
-        break;
-    }
-    v._type = UNDEFINED;
+    setType (v.type ());
+    setFlags (v.flags ());
+    adoptChildren ();
+    v.setType (UNDEFINED);
+    v.setFlags (0);
+    // v мог быть элементом документа: там теперь null
+    if (v.parent ()) v.parent ()->dropMemo ();
 }
 
 JsonValue& JsonValue::operator= (const JsonValue& v)
 {
     if (&v == this) return *this;
 
-    Type savedType = v._type;
-    _Value savedValue;
-
-    switch (savedType)
-    {
-    case OBJECT:
-        savedValue._o = new ObjectContainer (*v._value._o);
-        for (auto& p : *savedValue._o) p.second._parent = this;
-        break;
-
-    case ARRAY:
-        savedValue._a = new ArrayContainer (*v._value._a);
-        for (auto& rv : * (savedValue._a)) rv._parent = this;
-        break;
-
-    case STRING:
-        savedValue._s = new std::string (*v._value._s);
-        break;
-
-    default:
-        savedValue = v._value;
-        break;
-    }
+    // v может оказаться потомком этого узла, поэтому копируем до reset
+    JsonValue saved;
+    saved.copyFrom (v, storageArena ());
 
     reset ();
 
-    _type = savedType;
-    _value = savedValue;
+    setType (saved.type ());
+    setFlags (saved.flags ());
+    _value = saved._value;
+    saved.setType (UNDEFINED);
+
+    adoptChildren ();
+    if (parent ()) parent ()->dropMemo ();
 
     return *this;
 }
@@ -328,38 +502,44 @@ JsonValue& JsonValue::operator= (JsonValue&& v)
 {
     if (&v == this) return *this;
 
+    // в узел из арены нельзя переносить память из кучи (и из чужой арены)
+    JsonArena* arena = storageArena ();
+    if (arena && v.type () != UNDEFINED)
+    {
+        bool sameArena = (v.type () == OBJECT && v._value._o->arena () == arena) ||
+                         (v.type () == ARRAY && v._value._a->arena () == arena);
+        bool ownsMemory = v.type () == OBJECT || v.type () == ARRAY ||
+                          (v.type () == STRING && (v.flags () & INLINE_STRING) == 0);
+        if (!sameArena && ownsMemory)
+        {
+            return *this = (const JsonValue&)v;
+        }
+    }
+
     reset ();
 
-    _type = v._type;
+    setType (v.type ());
+    setFlags (v.flags ());
     _value = v._value;
 
-    v._type = UNDEFINED;
-
-    switch (_type)
-    {
-    case OBJECT:
-        for (auto& p : *_value._o) p.second._parent = this;
-        break;
-
-    case ARRAY:
-        for (auto& rv : * (_value._a)) rv._parent = this;
-        break;
+    v.setType (UNDEFINED);
+    v.setFlags (0);
 
-    default:
-        break;
-    }
+    adoptChildren ();
+    if (parent ()) parent ()->dropMemo ();
+    if (v.parent ()) v.parent ()->dropMemo ();
 
     return *this;
 }
 
 bool JsonValue::asBoolean (bool defaultValue) const
 {
-    switch (_type)
+    switch (type ())
     {
     case BOOLEAN:
         return _value._l;
     case STRING:
-        return !_value._s->empty();
+        return stringSize () != 0;
     case INTEGER:
         return _value._i != 0;
     case NUMBER:
@@ -375,7 +555,7 @@ bool JsonValue::asBoolean (bool defaultValue) const
 double JsonValue::asNumber (double defaultValue) const
 {
     char *p = 0;
-    switch (_type)
+    switch (type ())
     {
     case BOOLEAN:
         return _value._l ? 1 : 0;
@@ -384,7 +564,7 @@ double JsonValue::asNumber (double defaultValue) const
     case NUMBER:
         return _value._d;
     case STRING:
-        return strtod (_value._s->c_str(), &p);
+        return strtod (stringData (), &p);
     default:
         return defaultValue;
     }
@@ -393,7 +573,7 @@ double JsonValue::asNumber (double defaultValue) const
 long long JsonValue::asInt (long long defaultValue) const
 {
     char *p = 0;
-    switch (_type)
+    switch (type ())
     {
     case BOOLEAN:
         return _value._l ? 1 : 0;
@@ -402,7 +582,7 @@ long long JsonValue::asInt (long long defaultValue) const
     case NUMBER:
         return (long long)_value._d;
     case STRING:
-        return strtoll (_value._s->c_str(), &p, 10);
+        return strtoll (stringData (), &p, 10);
     default:
         return defaultValue;
     }
@@ -410,7 +590,7 @@ long long JsonValue::asInt (long long defaultValue) const
 
 std::string JsonValue::asString (const std::string& defaultValue) const
 {
-    switch (_type)
+    switch (type ())
     {
     case ARRAY:
         return "Array[]";
@@ -423,7 +603,7 @@ std::string JsonValue::asString (const std::string& defaultValue) const
     case NUMBER:
         return numberToString (_value._d);
     case STRING:
-        return *_value._s;
+        return std::string (stringData (), stringSize ());
     case UNDEFINED:
     default:
         return defaultValue;
@@ -432,22 +612,28 @@ std::string JsonValue::asString (const std::string& defaultValue) const
 
 std::string JsonValue::asEscapedString (const std::string& defaultValue) const
 {
-    return escapedString (this->asString (defaultValue));
+    if (type () != STRING) return escapedString (this->asString (defaultValue));
+
+    std::string res;
+    JsonStringSink out (res);
+    escape (out, stringData (), stringSize ());
+    out.flush ();
+    return res;
 }
 
 bool JsonValue::hasKey (const std::string &str) const
 {
-    if (_type != OBJECT) return false;
-    return _value._o->find(str) != _value._o->end();
+    if (type () != OBJECT) return false;
+    return _value._o->has_key(str);
 }
 
 JsonValue& JsonValue::operator[] (size_t key)
 {
-    if (_type != ARRAY)
+    if (type () != ARRAY)
     {
         reset ();
-        _type = ARRAY;
-        _value._a = new ArrayContainer;
+        setContainer (ARRAY, storageArena ());
+        if (parent ()) parent ()->dropMemo ();
     }
 
     if (key < _value._a->size())
@@ -456,69 +642,125 @@ JsonValue& JsonValue::operator[] (size_t key)
     }
     else
     {
+        dropMemo ();
+        // элементы не переезжают, так что родителя получают только новые
         size_t oldSize = _value._a->size();
         _value._a->resize (key + 1);
-        for (auto& rv : * (_value._a)) rv._parent = this;
+        for (size_t i = oldSize; i <= key; ++i)
+        {
+            (*_value._a)[i].setParent (this);
+            (*_value._a)[i].setSlot (i);
+        }
         return _value._a->back ();
     }
 }
 
 JsonValue& JsonValue::add (const JsonValue& v)
 {
-    size_t oldSize = size();
-    (*this)[oldSize] = v;
-    return (*this)[oldSize];
+    JsonValue& rv = (*this)[size()];
+    rv = v;
+    return rv;
+}
+
+JsonValue& JsonValue::add (JsonValue&& v)
+{
+    JsonValue& rv = (*this)[size()];
+    rv = std::move(v);
+    return rv;
 }
 
 bool JsonValue::insert(size_t pos, const JsonValue &v)
 {
-    if (_type != ARRAY || pos > _value._a->size())
+    if (type () != ARRAY || pos > _value._a->size())
     {
         return false;
     }
 
+    dropMemo ();
     auto it = _value._a->begin();
     std::advance(it, pos);
-    _value._a->insert(it, v);
-    for (auto& rv : * (_value._a)) rv._parent = this;
+    // элемент сначала встаёт на место, а потом получает значение:
+    // так его содержимое попадает в ту же память (кучу или арену),
+    // что и сам контейнер
+    JsonValue& nv = *_value._a->insert(it, JsonValue());
+    nv.setParent (this);
+    nv.setSlot (pos);
+    nv = v;
     return true;
 }
 
-bool JsonValue::insert(size_t pos, const std::string &key, const JsonValue &v)
+bool JsonValue::insert(size_t pos, JsonValue&& v)
 {
-    if (_type != OBJECT || pos > _value._o->size())
+    if (type () != ARRAY || pos > _value._a->size())
     {
         return false;
     }
 
-    auto it = _value._o->begin();
+    dropMemo ();
+    auto it = _value._a->begin();
     std::advance(it, pos);
-    _value._o->insert(it, key, v);
-    for (auto& p : *_value._o) p.second._parent = this;
+    JsonValue& nv = *_value._a->insert(it, JsonValue());
+    nv.setParent (this);
+    nv.setSlot (pos);
+    nv = std::move(v);
+    return true;
+}
+
+bool JsonValue::insert(size_t pos, const std::string &key, const JsonValue &v)
+{
+    if (type () != OBJECT || pos > _value._o->size())
+    {
+        return false;
+    }
+
+    return insert (pos, key, JsonValue (v));
+}
+
+bool JsonValue::insert(size_t pos, const std::string &key, JsonValue &&v)
+{
+    if (type () != OBJECT || pos > _value._o->size())
+    {
+        return false;
+    }
+
+    // v может быть прежним значением key, которое insert удалит
+    JsonValue saved(std::move(v));
+    dropMemo ();
+    auto nit = _value._o->insert(_value._o->nth(pos), key, JsonValue());
+    JsonValue& nv = nit->second;
+    nv.setParent (this);
+    nv.setSlot (_value._o->position(nit));
+    nv = std::move(saved);
     return true;
 }
 
 JsonValue& JsonValue::operator[] (const std::string& key)
 {
-    if (_type != OBJECT)
+    if (type () != OBJECT)
     {
         reset ();
-        _type = OBJECT;
-        _value._o = new ObjectContainer;
+        setContainer (OBJECT, storageArena ());
+        if (parent ()) parent ()->dropMemo ();
     }
-    JsonValue& rv = _value._o->operator[](key);
-    rv._parent = this;
+    JsonValue* found = _value._o->get(key);
+    if (found) return *found;
+
+    auto it = _value._o->insert(key, JsonValue());
+    JsonValue& rv = it->second;
+    dropMemo ();
+    rv.setParent (this);
+    rv.setSlot (_value._o->position(it));
     return rv;
 }
 
 const JsonValue& JsonValue::operator[] (const std::string& key) const
 {
-    switch (_type)
+    switch (type ())
     {
     case OBJECT:
     {
-        ObjectContainer::iterator i = _value._o->find (key);
-        if (i != _value._o->end ()) return i->second;
+        const JsonValue* rv = _value._o->get (key);
+        if (rv) return *rv;
     }
     break;
 
@@ -530,7 +772,7 @@ const JsonValue& JsonValue::operator[] (const std::string& key) const
 
 const JsonValue& JsonValue::operator[] (size_t key) const
 {
-    switch (_type)
+    switch (type ())
     {
     case ARRAY:
     {
@@ -546,7 +788,7 @@ const JsonValue& JsonValue::operator[] (size_t key) const
 
 size_t JsonValue::size () const
 {
-    switch (_type)
+    switch (type ())
     {
     case ARRAY:
         return _value._a->size();
@@ -559,7 +801,8 @@ size_t JsonValue::size () const
 
 void JsonValue::clear ()
 {
-    switch (_type)
+    dropMemo ();
+    switch (type ())
     {
     case ARRAY:
         _value._a->clear ();
@@ -576,15 +819,16 @@ void JsonValue::clear ()
 
 void JsonValue::erase (const JsonValue& key)
 {
-    switch (_type)
+    dropMemo ();
+    switch (type ())
     {
     case ARRAY:
     {
-        int N = key.asInt();
-        if (N >= 0 && N < (int)_value._a->size())
+        long long N = key.asInt();
+        if (N >= 0 && (unsigned long long)N < _value._a->size())
         {
             auto it = _value._a->begin();
-            std::advance(it, N);
+            std::advance(it, (size_t)N);
             _value._a->erase (it);
         }
     }
@@ -601,7 +845,7 @@ void JsonValue::erase (const JsonValue& key)
 
 std::vector<std::string> JsonValue::indexes () const
 {
-    if (_type != OBJECT) return std::vector<std::string>();
+    if (type () != OBJECT) return std::vector<std::string>();
     std::vector<std::string> rv(_value._o->size());
     std::vector<std::string>::iterator p = rv.begin ();
     for (auto i = _value._o->begin(); i != _value._o->end(); ++i)
@@ -614,7 +858,7 @@ std::vector<std::string> JsonValue::indexes () const
 
 JsonValue JsonValue::operator+ (const JsonValue& v) const
 {
-    switch (_type)
+    switch (type ())
     {
     case UNDEFINED:
         return v;
@@ -625,23 +869,18 @@ JsonValue JsonValue::operator+ (const JsonValue& v) const
     case NUMBER:
         return _value._d + v.asNumber();
     case STRING:
-        return *_value._s + v.asString();
+        return asString() + v.asString();
     case ARRAY:
     {
         JsonValue rv(*this);
-        switch (v._type)
+        switch (v.type ())
         {
         case ARRAY:
-            rv._value._a->insert(
-                rv._value._a->end(),
-                v._value._a->begin(),
-                v._value._a->end());
-            for (auto& rv : * (_value._a)) rv._parent = this;
+            for (const auto& a : *v._value._a) rv.add(a);
             break;
 
         default:
-            rv._value._a->insert(rv._value._a->end(), v);
-            for (auto& rv : * (_value._a)) rv._parent = this;
+            rv.add(v);
             break;
         }
         return rv;
@@ -650,7 +889,7 @@ JsonValue JsonValue::operator+ (const JsonValue& v) const
     case OBJECT:
     {
         JsonValue rv(*this);
-        switch (v._type)
+        switch (v.type ())
         {
         case OBJECT:
             for (const auto& j : *v.asObject())
@@ -671,7 +910,7 @@ JsonValue JsonValue::operator+ (const JsonValue& v) const
 
 JsonValue JsonValue::operator| (const JsonValue& v) const
 {
-    switch (_type)
+    switch (type ())
     {
     case UNDEFINED:
         return v;
@@ -685,19 +924,14 @@ JsonValue JsonValue::operator| (const JsonValue& v) const
     case ARRAY:
     {
         JsonValue rv(*this);
-        switch (v._type)
+        switch (v.type ())
         {
         case ARRAY:
-            rv._value._a->insert(
-                rv._value._a->end(),
-                v._value._a->begin(),
-                v._value._a->end());
-            for (auto& rv : * (_value._a)) rv._parent = this;
+            for (const auto& a : *v._value._a) rv.add(a);
             break;
 
         default:
-            rv._value._a->insert(rv._value._a->end(), v);
-            for (auto& rv : * (_value._a)) rv._parent = this;
+            rv.add(v);
             break;
         }
         return rv;
@@ -706,7 +940,7 @@ JsonValue JsonValue::operator| (const JsonValue& v) const
     case OBJECT:
     {
         JsonValue rv(*this);
-        switch (v._type)
+        switch (v.type ())
         {
         case OBJECT:
             for (const auto& j : *v.asObject())
@@ -730,31 +964,19 @@ JsonValue JsonValue::operator| (const JsonValue& v) const
 /*
 11.9.3 The Abstract Equality Comparison Algorithm
 http://www.ecma-international.org/ecma-262/5.1/#sec-11.9.3
+
+Значения одного типа сравниваются как в equals -- в том числе NaN
+равен NaN, и на любой глубине, и на верхнем уровне
 */
 bool JsonValue::operator==(const JsonValue& v) const
 {
-    if (_type == v._type)
+    if (type () == v.type ())
     {
-        switch (_type)
-        {
-        case UNDEFINED:
-            return true;
-        case BOOLEAN:
-            return _value._l == v._value._l;
-        case INTEGER:
-            return _value._i == v._value._i;
-        case NUMBER:
-            return _value._d == v._value._d;
-        case STRING:
-            return *_value._s == *v._value._s;
-        case ARRAY:
-        case OBJECT:
-            return stringifyThis() == v.stringifyThis();
-        }
+        return equals(v);
     }
     else
     {
-        switch (v._type)
+        switch (v.type ())
         {
         case BOOLEAN:
             return asBoolean() == v._value._l;
@@ -763,7 +985,7 @@ bool JsonValue::operator==(const JsonValue& v) const
         case NUMBER:
             return asNumber() == v._value._d;
         case STRING:
-            return asString() == *v._value._s;
+            return asString() == v.asString();
         case UNDEFINED:
         case ARRAY:
         case OBJECT:
@@ -773,30 +995,156 @@ bool JsonValue::operator==(const JsonValue& v) const
     return false;
 }
 
-std::string JsonValue::stringifyThis() const
+bool JsonValue::equals(const JsonValue& v) const
 {
-    return stringify(*this, true);
+    if (this == &v) return true;
+    if (type () != v.type ()) return false;
+
+    switch (type ())
+    {
+    case UNDEFINED:
+        return true;
+    case BOOLEAN:
+        return _value._l == v._value._l;
+    case INTEGER:
+        return _value._i == v._value._i;
+    case NUMBER:
+        // NaN равен NaN, иначе значение не нашлось бы в хеш-таблице
+        return _value._d == v._value._d ||
+               (_value._d != _value._d && v._value._d != v._value._d);
+    case STRING:
+        return stringSize () == v.stringSize () &&
+               memcmp (stringData (), v.stringData (), stringSize ()) == 0;
+    case ARRAY:
+    {
+        const ArrayContainer& a = *_value._a;
+        const ArrayContainer& b = *v._value._a;
+        if (a.size () != b.size ()) return false;
+        for (size_t i = 0; i < a.size (); ++i)
+        {
+            if (!a[i].equals (b[i])) return false;
+        }
+        return true;
+    }
+    case OBJECT:
+    {
+        if (_value._o->size () != v._value._o->size ()) return false;
+        // обычно члены идут в одном порядке -- тогда обходимся без поиска
+        auto j = v._value._o->begin ();
+        for (const auto& p : *_value._o)
+        {
+            const JsonValue* q = (j->first == p.first) ? &j->second
+                                                       : v._value._o->get (p.first);
+            if (q == 0 || !p.second.equals (*q)) return false;
+            ++j;
+        }
+        return true;
+    }
+    }
+    return false;
 }
 
-std::string JsonValue::prettyStringifyThis() const
+namespace
 {
-    return prettyStringify(*this);
+
+inline uint64_t hashMix (uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
 }
 
-ObjectContainer* JsonValue::asObject () const
+inline uint64_t hashCombine (uint64_t h, uint64_t v)
 {
-    switch (_type)
+    return hashMix (h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+/* FNV-1a */
+inline uint64_t hashBytes (const char* s, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; ++i)
     {
-    case OBJECT:
-        return _value._o;
-    default:
-        return 0;
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+} // namespace
+
+size_t JsonValue::hash() const
+{
+    uint64_t h = hashMix ((uint64_t)type () + 1);
+
+    switch (type ())
+    {
+    case UNDEFINED:
+        break;
+    case BOOLEAN:
+        h = hashCombine (h, _value._l ? 1 : 0);
+        break;
+    case INTEGER:
+        h = hashCombine (h, (uint64_t)_value._i);
+        break;
+    case NUMBER:
+    {
+        double d = _value._d;
+        uint64_t bits = 0;
+        if (d != d) bits = 0x7ff8000000000000ULL;   // все NaN одинаковы
+        else if (d != 0) memcpy (&bits, &d, sizeof (bits));  // +0 == -0
+        h = hashCombine (h, bits);
+        break;
+    }
+    case STRING:
+        h = hashCombine (h, hashBytes (stringData (), stringSize ()));
+        break;
+    case ARRAY:
+        for (const auto& a : *_value._a) h = hashCombine (h, a.hash ());
+        break;
+    case OBJECT:
+    {
+        // порядок членов не важен: складываем хеши пар
+        uint64_t sum = 0;
+        for (const auto& p : *_value._o)
+        {
+            sum += hashCombine (hashBytes (p.first.data (), p.first.size ()),
+                                p.second.hash ());
+        }
+        h = hashCombine (h, sum);
+        break;
+    }
+    }
+    return (size_t)h;
+}
+
+std::string JsonValue::stringifyThis() const
+{
+    return stringify(*this, true);
+}
+
+std::string JsonValue::prettyStringifyThis() const
+{
+    return prettyStringify(*this);
+}
+
+ObjectContainer* JsonValue::asObject () const
+{
+    switch (type ())
+    {
+    case OBJECT:
+        return _value._o;
+    default:
+        return 0;
     }
 }
 
 ArrayContainer* JsonValue::asArray () const
 {
-    switch (_type)
+    switch (type ())
     {
     case ARRAY:
         return _value._a;
@@ -812,12 +1160,36 @@ ArrayContainer* JsonValue::asArray () const
 //
 //
 //////////////////////////////////////////////////////////////////////////////
-inline std::string jsmn_dump_string_token (jsmntok_t *obj, char* js)
+/* ключ объекта с раскодированными escape-последовательностями;
+   за ключом в буфере стоит закрывающая кавычка */
+static void decodeKey (const char* s, size_t n, std::string& key)
+{
+    const char* bs = (const char*)memchr (s, '\\', n);
+    if (bs == 0)
+    {
+        key.assign (s, n);
+        return;
+    }
+
+    size_t k = (size_t)(bs - s);
+    key.resize (n);
+    memcpy (&key[0], s, k);
+    key.resize (k + unescape (&key[k], bs, n - k));
+}
+
+static std::string decodeKey (const char* s, size_t n)
+{
+    std::string key;
+    decodeKey (s, n, key);
+    return key;
+}
+
+inline std::string jsmn_dump_string_token (jsmntok_t *obj, const char* js)
 {
-    return std::string(js + obj->start, (size_t)(obj->end - obj->start));
+    return decodeKey (js + obj->start, (size_t)(obj->end - obj->start));
 }
 
-JsonValue jsmn_dump_token (jsmntok_t **pobj, char* js)
+JsonValue jsmn_dump_token (jsmntok_t **pobj, const char* js)
 {
     jsmntok_t* obj = *pobj;
     
@@ -833,7 +1205,7 @@ JsonValue jsmn_dump_token (jsmntok_t **pobj, char* js)
         {
             JsonValue arr(JsonValue::Type::ARRAY);
             ArrayContainer& ac = *(arr.asArray());
-            for (int i = 0, osz = obj->size; i < osz; ++i)
+            for (size_t i = 0, osz = obj->size; i < osz; ++i)
             {
                 ac.emplace_back(jsmn_dump_token (&(++(*pobj)), js));
             }
@@ -843,9 +1215,12 @@ JsonValue jsmn_dump_token (jsmntok_t **pobj, char* js)
         case JSMN_OBJECT:
         {
             JsonValue obj2(JsonValue::Type::OBJECT);
-            for (int i = 0, osz = obj->size; i < osz; ++i)
+            for (size_t i = 0, osz = obj->size; i < osz; ++i)
             {
-                obj2[jsmn_dump_string_token (++(*pobj), js)] = jsmn_dump_token (&(++(*pobj)), js);
+                // ключ читаем отдельно: порядок вычисления операндов
+                // присваивания до C++17 не определён
+                std::string key = jsmn_dump_string_token (++(*pobj), js);
+                obj2[key] = jsmn_dump_token (&(++(*pobj)), js);
             }
             return obj2;
         }
@@ -855,243 +1230,837 @@ JsonValue jsmn_dump_token (jsmntok_t **pobj, char* js)
     }
 }
 
-JsonValue parse_string(const char* string)
+//////////////////////////////////////////////////////////////////////////////
+//
+//
+//  Однопроходный разбор: узлы JsonValue строятся прямо по байтам буфера,
+//  без промежуточного массива токенов jsmn
+//
+//
+//////////////////////////////////////////////////////////////////////////////
+namespace
 {
-    std::string s(string);
-    return parse_buffer(&s[0], s.size());
+
+inline bool isJsonSpace (char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-JsonValue parse_buffer (char* bufferHead, size_t bufferSize)
+inline bool isHexDigit (char c)
 {
-    JsonValue res;
-    
-    int r;
-    unsigned int num_tokens = 1024;
-    jsmntok_t* tokens = 0;
-    jsmn_parser parser;
-    jsmn_init (&parser);
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+           (c >= 'A' && c <= 'F');
+}
 
-LOOP_JSMN_ERROR_NOMEM:
+class JsonReader
+{
+public:
+    JsonReader (const char* buffer, size_t size, JsonArena* arena,
+                JsonBuilder::Storage& storage, std::string& key)
+        : _p(buffer), _end(buffer + size), _arena(arena),
+          _storage(storage), _key(key)
+    {
+    }
 
-    tokens = (jsmntok_t*)realloc(tokens, num_tokens * sizeof(jsmntok_t));
-    if (tokens == 0)
+    ///
+    /// \brief parse разбирает буфер итеративно, узлы создаются сразу
+    /// на своих местах через JsonBuilder, так что глубина вложенности
+    /// не влияет ни на стек, ни на число перекладываний узлов
+    ///
+    JsonValue parse ()
     {
-        exit(EXIT_FAILURE);
+        JsonValue res;
+        JsonBuilder builder (res, _arena, _storage);
+        if (!parseInto (builder)) res = JsonValue ();
+        return res;
     }
 
-    r = jsmn_parse (&parser, bufferHead, bufferSize, tokens, num_tokens);
+private:
+    void skipSpaces ()
+    {
+        while (_p != _end && isJsonSpace (*_p)) ++_p;
+    }
 
-    if ( r >= 0 )
+    bool parseInto (JsonBuilder& b)
     {
-        jsmntok_t *T = tokens;
-        res = jsmn_dump_token (&T, (char*)bufferHead);
+        skipSpaces ();
+        for (;;)
+        {
+            // ожидается значение
+            if (_p == _end) return false;
+            switch (*_p)
+            {
+            case '{':
+                ++_p;
+                b.beginObject ();
+                skipSpaces ();
+                if (_p != _end && *_p == '}')
+                {
+                    ++_p;
+                    b.endObject ();
+                    break;
+                }
+                if (!parseKey (b)) return false;
+                continue;
+
+            case '[':
+                ++_p;
+                b.beginArray ();
+                skipSpaces ();
+                if (_p != _end && *_p == ']')
+                {
+                    ++_p;
+                    b.endArray ();
+                    break;
+                }
+                continue;
 
+            case '\"':
+            {
+                const char* s = 0;
+                size_t n = 0;
+                if (!scanString (s, n)) return false;
+                b.token (s, n, true);
+            }
+            break;
+
+            case '-': case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+            case 't': case 'f': case 'n':
+                if (!parsePrimitive (b)) return false;
+                break;
+
+            default:
+                return false;
+            }
+
+            // значение прочитано: закрываем контейнеры или идём к следующему
+            for (;;)
+            {
+                skipSpaces ();
+                if (b.depth () == 0)
+                {
+                    // как и jsmn, считаем нулевой байт концом документа
+                    return _p == _end || *_p == 0;
+                }
+                if (_p == _end) return false;
+
+                char c = *_p++;
+                if (c == ',')
+                {
+                    skipSpaces ();
+                    if (b.inObject () && !parseKey (b)) return false;
+                    break;
+                }
+                if (c == ']' ? !b.endArray () :
+                        c == '}' ? !b.endObject () : true)
+                {
+                    return false;
+                }
+            }
+        }
     }
-    else if (r == JSMN_ERROR_NOMEM )
+
+    /* читает "ключ" : */
+    bool parseKey (JsonBuilder& b)
     {
-        num_tokens += num_tokens;
-        goto LOOP_JSMN_ERROR_NOMEM;
+        const char* s = 0;
+        size_t n = 0;
+        if (_p == _end || *_p != '\"' || !scanString (s, n)) return false;
+
+        skipSpaces ();
+        if (_p == _end || *_p != ':') return false;
+        ++_p;
+        skipSpaces ();
+
+        if (memchr (s, '\\', n))
+        {
+            decodeKey (s, n, _key);
+            return b.key (_key);
+        }
+        return b.key (s, n);
+    }
+
+    /*
+     * находит границы строки без кавычек, _p встаёт за закрывающую кавычку.
+     * Обычные байты пропускает findEscape; кроме кавычки и '\\' он
+     * останавливается на '/' и управляющих символах -- их разбор
+     * по-прежнему пропускает, отвергая только нулевой байт
+     */
+    bool scanString (const char*& s, size_t& n)
+    {
+        s = ++_p;
+        while (_p != _end)
+        {
+            _p += findEscape (_p, (size_t)(_end - _p));
+            if (_p == _end) break;
+            char c = *_p;
+            if (c == '\"')
+            {
+                n = (size_t)(_p - s);
+                ++_p;
+                return true;
+            }
+            if (c == 0) return false;
+            if (c == '\\')
+            {
+                if (++_p == _end) return false;
+                switch (*_p)
+                {
+                case '\"': case '/': case '\\': case 'b':
+                case 'f': case 'r': case 'n': case 't':
+                    break;
+                case 'u':
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        if (++_p == _end || !isHexDigit (*_p)) return false;
+                    }
+                    break;
+                default:
+                    return false;
+                }
+            }
+            ++_p;
+        }
+        return false;
+    }
+
+    bool parsePrimitive (JsonBuilder& b)
+    {
+        const char* s = _p;
+        while (_p != _end)
+        {
+            char c = *_p;
+            if (isJsonSpace (c) || c == ',' || c == ']' || c == '}') break;
+            if (c < 32 || c >= 127) return false;
+            ++_p;
+        }
+        return b.token (s, (size_t)(_p - s), false);
+    }
+
+    const char* _p;
+    const char* _end;
+    JsonArena* _arena;
+    JsonBuilder::Storage& _storage;
+    std::string& _key;
+};
+
+} // namespace
+
+JsonValue parse_string(const char* string, JsonArena* arena)
+{
+    return parse (string, strlen (string), arena);
+}
 
+JsonValue parse_buffer (char* bufferHead, size_t bufferSize, JsonArena* arena)
+{
+    return parse (bufferHead, bufferSize, arena);
+}
+
+struct JsonParser::Storage
+{
+    Storage () : tokens (0), capacity (0) {}
+
+    JsonBuilder::Storage builder;
+    std::string key;
+    jsmntok_t* tokens;
+    size_t capacity;
+};
+
+JsonParser::JsonParser ()
+    : _storage (new Storage ())
+{
+}
+
+JsonParser::~JsonParser ()
+{
+    free (_storage->tokens);
+    delete _storage;
+}
+
+JsonValue JsonParser::parse (const char* buffer, size_t size, JsonArena* arena)
+{
+    JsonReader reader (buffer, size, arena, _storage->builder, _storage->key);
+    return reader.parse ();
+}
+
+/* верхняя оценка числа лексем: каждое значение, кроме корня, стоит
+   сразу за '[', ':' или ',', а ключ объекта -- за '{' или ',' */
+static size_t countTokens (const char* buffer, size_t size)
+{
+    size_t n = 1;
+    for (size_t i = 0; i < size; ++i)
+    {
+        char c = buffer[i];
+        n += (c == '[') | (c == '{') | (c == ',') | (c == ':');
     }
-    else if (r == JSMN_ERROR_INVAL )
+    return n;
+}
+
+JsonValue JsonParser::parseJsmn (const char* buffer, size_t size)
+{
+    JsonValue res;
+    Storage& st = *_storage;
+
+    // лексем не больше, чем байт: если массива на size лексем нет,
+    // он сразу берётся по оценке countTokens, без повторов jsmn_parse
+    size_t need = st.capacity < 1024 ? 1024 : st.capacity;
+    if (need < size) need = std::max (need, countTokens (buffer, size));
+
+    jsmn_parser parser;
+    jsmn_init (&parser);
+    for (;;)
     {
+        if (need > st.capacity)
+        {
+            // уже прочитанные лексемы сохраняются: jsmn_parse продолжит с них
+            // при неудаче прежний буфер остаётся за контекстом
+            jsmntok_t* tokens = (jsmntok_t*)realloc (st.tokens, need * sizeof (jsmntok_t));
+            if (tokens == 0) throw std::bad_alloc ();
+            st.tokens = tokens;
+            st.capacity = need;
+        }
+
+        ptrdiff_t r = jsmn_parse (&parser, buffer, size, st.tokens, st.capacity);
+        if (r > 0)
+        {
+            jsmntok_t* T = st.tokens;
+            res = jsmn_dump_token (&T, buffer);
+        }
+        if (r != JSMN_ERROR_NOMEM) break;
+        need = st.capacity * 2;
     }
-    else if (r == JSMN_ERROR_PART )
+    return res;
+}
+
+void JsonParser::release (size_t keep)
+{
+    Storage& st = *_storage;
+    if (st.capacity * sizeof (jsmntok_t) > keep)
     {
+        free (st.tokens);
+        st.tokens = 0;
+        st.capacity = 0;
     }
+    if (st.builder.stack.capacity () * sizeof (JsonValue*) > keep)
+        std::vector<JsonValue*> ().swap (st.builder.stack);
+    if (st.builder.key.capacity () > keep) std::string ().swap (st.builder.key);
+    if (st.key.capacity () > keep) std::string ().swap (st.key);
+}
+
+JsonParser& JsonParser::local ()
+{
+    thread_local JsonParser parser;
+    return parser;
+}
 
-    free(tokens);
+JsonValue parse (const char* buffer, size_t size, JsonArena* arena)
+{
+    JsonParser& parser = JsonParser::local ();
+    JsonValue res = parser.parse (buffer, size, arena);
+    parser.release (JsonParser::RETAIN);
+    return res;
+}
 
+JsonValue parse_buffer_jsmn (const char* buffer, size_t size)
+{
+    JsonParser& parser = JsonParser::local ();
+    JsonValue res = parser.parseJsmn (buffer, size);
+    parser.release (JsonParser::RETAIN);
     return res;
 }
 
-JsonValue parse_file (const char* fileName)
+/*
+ * Обычный файл отображается в память только для чтения и разбирается
+ * прямо оттуда: ни копии в куче, ни лишнего RSS -- прочитанные страницы
+ * ядро может вытеснить. Каналы и прочие файлы без размера читаются
+ * целиком, как раньше
+ */
+JsonValue parse_file (const char* fileName, JsonArena* arena)
 {
     JsonValue res;
-    char* js = 0;
-    size_t filesize = 0;
+    int fd = open (fileName, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return res;
 
-    FILE* f = fopen (fileName, "rb");
-    if (f == 0)
+    struct stat st;
+    if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0)
     {
-        return res;
+        size_t size = (size_t)st.st_size;
+        void* p = mmap (0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            close (fd);
+            madvise (p, size, MADV_SEQUENTIAL);
+            res = parse ((const char*)p, size, arena);
+            munmap (p, size);
+            return res;
+        }
     }
 
-    fseek(f,0,SEEK_END);
-    filesize=(size_t)ftell(f);
-    fseek(f,0,SEEK_SET);
-    js=(char*)malloc(filesize);
-    if (js) {
-        filesize = fread(js, 1, filesize, f);
-        fclose(f);
-        res = parse_buffer (js, filesize);
-        free(js);
+    std::string js;
+    char buf[65536];
+    for (;;)
+    {
+        ssize_t r = read (fd, buf, sizeof (buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        js.append (buf, (size_t)r);
     }
+    close (fd);
+    if (!js.empty ()) res = parse (js.data (), js.size (), arena);
     return res;
 }
 
-std::string prettyStringify (const JsonValue& v, const std::string &indent,
-                             const std::string &indent00,
-                             const std::string &indent11,
-                             const std::string &eol, bool sorted)
+/*
+ * Сравнение по кодовым единицам UTF-16. До первого различия строки
+ * совпадают, поэтому различие либо внутри одного символа (тогда порядок
+ * байтов UTF-8 совпадает с порядком UTF-16), либо в первых байтах
+ * разных символов. Во втором случае по первому байту видно, что символ
+ * U+E000..U+FFFF (EE, EF) больше символа вне BMP (F0..F4)
+ */
+bool JsonKeyLess::operator() (const std::string& a, const std::string& b) const
 {
-    std::string res;
-    std::string nextIdent = indent11 + indent;
+    size_t n = a.size () < b.size () ? a.size () : b.size ();
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) ++i;
+    if (i == n) return a.size () < b.size ();
 
-    switch (v.type())
+    unsigned x = (unsigned char)a[i];
+    unsigned y = (unsigned char)b[i];
+    if ((x & 0xC0) != 0x80 && (y & 0xC0) != 0x80)
     {
-    case JsonValue::Type::UNDEFINED :
-        return std::string ("null");
+        if (x == 0xEE || x == 0xEF) x += 0x10;
+        if (y == 0xEE || y == 0xEF) y += 0x10;
+    }
+    return x < y;
+}
+
+void prettyStringify (JsonSink& out, const JsonValue& v,
+                      const std::string &indent,
+                      const std::string &indent0,
+                      const std::string &indent1,
+                      const std::string &eol, bool sorted)
+{
+    JsonWriter<JsonSink> writer (out, indent, indent0, indent1, eol, sorted);
+    writer.write (v);
+}
 
-    case JsonValue::Type::INTEGER :
-    case JsonValue::Type::NUMBER :
-    case JsonValue::Type::BOOLEAN :
-        return v.asString ();
+void stringify (JsonSink& out, const JsonValue& v, bool sorted)
+{
+    static const std::string empty;
+    JsonWriter<JsonSink> writer (out, empty, empty, empty, empty, sorted);
+    writer.write (v);
+}
 
-    case JsonValue::Type::STRING :
+void canonicalStringify (JsonSink& out, const JsonValue& v)
+{
+    static const std::string empty;
+    JsonWriter<JsonSink> writer (out, empty, empty, empty, empty, true, true);
+    writer.write (v);
+}
+
+size_t JsonValue::serializedSize () const
+{
+    static const std::string empty;
+    return serializedSize (empty, empty, empty, empty);
+}
+
+size_t JsonValue::serializedSize (const std::string &indent,
+                                  const std::string &indent0,
+                                  const std::string &indent1,
+                                  const std::string &eol) const
+{
+    JsonCounter out;
+    JsonWriter<JsonCounter> writer (out, indent, indent0, indent1, eol, false);
+    writer.write (*this);
+    return out.size;
+}
+
+size_t JsonValue::canonicalSize () const
+{
+    static const std::string empty;
+    JsonCounter out;
+    JsonWriter<JsonCounter> writer (out, empty, empty, empty, empty, true, true);
+    writer.write (*this);
+    return out.size;
+}
+
+std::string JsonMemo::_large;
+
+const std::string* JsonMemo::set (std::string& text) const
+{
+    std::string* p = &_large;
+    if (text.size () <= MAX_TEXT)
     {
-        res += "\"";
-        res += v.asEscapedString ();
-        res += "\"";
-        return res;
+        text.shrink_to_fit ();
+        p = new std::string (std::move (text));
     }
-    case JsonValue::Type::ARRAY :
+
+    std::string* expected = 0;
+    if (!_text.compare_exchange_strong (expected, p, std::memory_order_acq_rel))
     {
-        res.reserve(1024);
-        res += "[";
-        res += eol;
+        if (p != &_large) delete p;
+        p = expected;
+    }
+    return p == &_large ? 0 : p;
+}
+
+bool JsonMemo::reset () const
+{
+    // обычно кэша нет, и незачем платить за атомарный обмен
+    std::string* p = _text.load (std::memory_order_relaxed);
+    if (p == 0) return false;
+    if (p == &_large) return true;
+    p = _text.exchange (0);
+    delete p;
+    return p != 0;
+}
+
+void memoStringify (JsonSink& out, const JsonValue& v)
+{
+    static const std::string empty;
+    JsonWriter<JsonSink> writer (out, empty, empty, empty, empty, false, false, true);
+    writer.write (v);
+}
+
+std::string memoStringify (const JsonValue& v)
+{
+    std::string res;
+    JsonStringSink out (res);
+    memoStringify (out, v);
+    out.flush ();
+    return res;
+}
+
+std::string canonicalStringify (const JsonValue& v)
+{
+    std::string res;
+    JsonStringSink out (res);
+    canonicalStringify (out, v);
+    out.flush ();
+    return res;
+}
+
+std::string prettyStringify (const JsonValue& v, const std::string &indent,
+                             const std::string &indent0,
+                             const std::string &indent1,
+                             const std::string &eol, bool sorted)
+{
+    std::string res;
+    JsonStringSink out (res);
+    prettyStringify (out, v, indent, indent0, indent1, eol, sorted);
+    out.flush ();
+    return res;
+}
 
-        int i = 0;
-        const ArrayContainer& ac = *v.asArray();
-        for (auto a = ac.begin(), e = ac.end(); a != e; ++a)
+std::string stringify (const JsonValue& v, bool sorted)
+{
+    std::string res;
+    JsonStringSink out (res);
+    stringify (out, v, sorted);
+    out.flush ();
+    return res;
+}
+
+namespace
+{
+
+///
+/// \brief ParallelStringify делит элементы корневого массива (члены
+/// объекта) на куски и пишет их в отдельные строки на нескольких
+/// потоках; вызывающий поток тоже берёт куски и выводит готовые по
+/// порядку, сразу освобождая их память.
+///
+/// Дерево только читается; порядок больших объектов берётся из
+/// ObjectContainer::sorted, который можно строить из разных потоков.
+///
+class ParallelStringify
+{
+public:
+    enum { MIN_ELEMENTS = 1024, CHUNKS_PER_THREAD = 8 };
+
+    ParallelStringify (const JsonValue& v, bool sorted, size_t size, unsigned threads)
+        : _array (v.type () == JsonValue::Type::ARRAY ? v.asArray () : 0),
+          _sorted (sorted), _size (size), _next (0)
+    {
+        if (_array == 0)
         {
-            if (i)
+            // члены раскладываются заранее, чтобы кусок можно было найти по номеру
+            const ObjectContainer& oc = *v.asObject ();
+            const ObjectContainer::value_type* small[JsonWriter<JsonSink>::SMALL_OBJECT];
+            if (sorted)
             {
-                res += ",";
-                res += eol;
+                const ObjectContainer::value_type* const* p =
+                    JsonWriter<JsonSink>::sortedMembers (oc, small, _members);
+                if (p != _members.data ()) _members.assign (p, p + oc.size ());
+            }
+            else
+            {
+                _members.reserve (oc.size ());
+                for (const auto& p : oc) _members.push_back (&p);
             }
-
-            res += indent11;
-            res += prettyStringify (*a, indent, indent11, nextIdent, eol);
-
-            ++i;
         }
-        res += eol;
-        res += indent00;
-        res += "]";
-        return res;
+
+        size_t count = (size_t)threads * CHUNKS_PER_THREAD;
+        if (count > _size) count = _size;
+        _chunks.resize (count);
     }
 
-    case JsonValue::Type::OBJECT :
+    void write (JsonSink& out, unsigned threads)
     {
-        res.reserve(1024);
-        res += "{";
-        res += eol;
+        std::vector<std::thread> workers;
+        try
+        {
+            for (unsigned i = 1; i < threads; ++i)
+                workers.emplace_back ([this]() { while (work ()) {} });
+        }
+        catch (const std::system_error&)
+        {
+            // поток не создался -- обойдёмся теми, что есть
+        }
 
-        if (sorted)
+        std::exception_ptr error;
+        try
         {
-            int i = 0;
-            std::vector<std::string> keys = v.indexes();
-            std::sort(keys.begin(), keys.end());
-            for (auto key : keys)
+            out.put (_array ? '[' : '{');
+            for (Chunk& c : _chunks)
             {
-                if (i)
+                // пока нужный кусок не готов, помогаем писать следующие
+                while (!wait (c) && work ()) {}
                 {
-                    res += ",";
-                    res += eol;
+                    std::unique_lock<std::mutex> lock (_mutex);
+                    _ready.wait (lock, [&c]() { return c.done; });
                 }
-
-                res += indent11;
-                res += "\"";
-                res += escapedString (key);
-                res += "\":";
-                res += prettyStringify (v[key], indent, indent11, nextIdent, eol);
-
-                ++i;
+                if (c.error && !error) error = c.error;
+                if (!error) out.write (c.text.data (), c.text.size ());
+                std::string ().swap (c.text);
             }
-            res += eol;
+            out.put (_array ? ']' : '}');
         }
-        else
+        catch (...)
         {
-            int i = 0;
-            ObjectContainer& oc = *v.asObject();
-            for (auto p = oc.begin(), e = oc.end(); p != e; ++p)
-            {
-                if (i)
-                {
-                    res += ",";
-                    res += eol;
-                }
+            // out не принял данные (например, bad_alloc): новых кусков
+            // потокам не даём и дожидаемся их, иначе ~thread вызовет terminate
+            _next.store (_chunks.size ());
+            for (std::thread& t : workers) t.join ();
+            throw;
+        }
+
+        for (std::thread& t : workers) t.join ();
+        if (error) std::rethrow_exception (error);
+    }
 
-                res += indent11;
-                res += "\"";
-                res += escapedString (p->first);
-                res += "\":";
-                res += prettyStringify (p->second, indent, indent11, nextIdent, eol);
+private:
+    struct Chunk
+    {
+        std::string text;
+        std::exception_ptr error;
+        bool done = false;
+    };
 
-                ++i;
-            }
-            res += eol;
+    bool wait (Chunk& c)
+    {
+        std::lock_guard<std::mutex> lock (_mutex);
+        return c.done;
+    }
+
+    /* берёт очередной кусок; false -- разбирать больше нечего */
+    bool work ()
+    {
+        size_t k = _next.fetch_add (1);
+        if (k >= _chunks.size ()) return false;
+
+        Chunk& c = _chunks[k];
+        std::exception_ptr error;
+        try
+        {
+            render (c.text, _size * k / _chunks.size (), _size * (k + 1) / _chunks.size ());
         }
-        res += indent00;
-        res += "}";
-        return res;
+        catch (...)
+        {
+            error = std::current_exception ();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock (_mutex);
+            c.error = error;
+            c.done = true;
+        }
+        _ready.notify_all ();
+        return true;
     }
 
-    default:
-        break;
+    void render (std::string& text, size_t begin, size_t end)
+    {
+        static const std::string empty;
+        JsonStringSink out (text);
+        JsonWriter<JsonSink> writer (out, empty, empty, empty, empty, _sorted);
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (i) out.put (',');
+            if (_array) writer.write ((*_array)[i], 1);
+            else writer.member (*_members[i], 1);
+        }
+        out.flush ();
     }
-    return res;
-}
 
-std::string stringify (const JsonValue& v, bool sorted)
+    const ArrayContainer* _array;
+    std::vector<const ObjectContainer::value_type*> _members;
+    bool _sorted;
+    size_t _size;
+    std::vector<Chunk> _chunks;
+    std::atomic<size_t> _next;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+};
+
+} // namespace
+
+void parallelStringify (JsonSink& out, const JsonValue& v, bool sorted, unsigned threads)
 {
-    return prettyStringify (v, "", "", "", "", sorted);
+    if (threads == 0) threads = std::thread::hardware_concurrency ();
+
+    size_t size = 0;
+    if (v.type () == JsonValue::Type::ARRAY) size = v.asArray ()->size ();
+    else if (v.type () == JsonValue::Type::OBJECT) size = v.asObject ()->size ();
+
+    if (threads < 2 || size < ParallelStringify::MIN_ELEMENTS)
+    {
+        stringify (out, v, sorted);
+        return;
+    }
+
+    ParallelStringify writer (v, sorted, size, threads);
+    writer.write (out, threads);
 }
 
-const JsonValue* JsonValue::parent() const
+std::string parallelStringify (const JsonValue& v, bool sorted, unsigned threads)
 {
-    return _parent;
+    std::string res;
+    JsonStringSink out (res);
+    parallelStringify (out, v, sorted, threads);
+    out.flush ();
+    return res;
 }
 
 const JsonValue* JsonValue::root() const
 {
-    const JsonValue* root = this->_parent ? this->_parent : this;
-    while (root && root->_parent) root = root->_parent;
+    const JsonValue* root = parent () ? parent () : this;
+    while (root && root->parent ()) root = root->parent ();
     return root;
 }
 
 JsonValue JsonValue::key() const
 {
-    if (_parent != 0)
+    ptrdiff_t n = pos ();
+    if (n < 0) return JsonValue();
+    if (parent ()->type () == OBJECT)
+        return JsonValue (parent ()->_value._o->nth(n)->first);
+    return JsonValue ((size_t)n);
+}
+
+/*
+ * Позиция берётся из _slot за O(1). Вставка и удаление в середине
+ * контейнера позиции соседей не трогают (как и прямые изменения через
+ * asArray()/asObject()), поэтому подсказка проверяется, а при промахе
+ * контейнер-владелец перенумеровывается целиком -- один раз на серию
+ * изменений, а не на каждое.
+ *
+ * _slot 32-битный, чтобы узел не вырос на 8 байт; в контейнере больше
+ * 2^32 элементов позиция восстанавливается проверкой slot + k * 2^32
+ */
+ptrdiff_t JsonValue::pos() const
+{
+    const JsonValue* p = parent ();
+    if (p == 0) return -1;
+
+    const uint64_t wrap = (uint64_t)UINT32_MAX + 1;
+    size_t size = p->size ();
+    for (uint64_t n = slot (); n < size; n += wrap)
     {
-        for (const auto& p : * (this->_parent))
-        {
-            if (&(p.value) == this) return p.key;
-        }
+        if (&p->at ((size_t)n) == this) return (ptrdiff_t)n;
     }
-    return JsonValue();
+
+#ifdef USE_COMPACT_VALUE_LAYOUT
+    for (size_t n = 0; n < size; ++n)
+    {
+        if (&p->at (n) == this) return (ptrdiff_t)n;
+    }
+#else
+    p->renumberChildren ();
+    for (uint64_t n = slot (); n < size; n += wrap)
+    {
+        if (&p->at ((size_t)n) == this) return (ptrdiff_t)n;
+    }
+#endif
+    return -1;
 }
 
-int JsonValue::pos() const
+/* выставляет родителя и позицию всем детям -- после переезда контейнера */
+void JsonValue::adoptChildren ()
 {
-    if (_parent != 0)
+    size_t n = 0;
+    switch (type ())
     {
-        int rv = 0;
-        for (const auto& p : * (this->_parent))
+    case OBJECT:
+        for (auto& p : *_value._o)
         {
-            if (&(p.value) == this) return rv;
-            ++rv;
+            p.second.setParent (this);
+            p.second.setSlot (n++);
         }
+        break;
+
+    case ARRAY:
+        for (auto& rv : * (_value._a))
+        {
+            rv.setParent (this);
+            rv.setSlot (n++);
+        }
+        break;
+
+    default:
+        break;
     }
-    return -1;
 }
 
-const JsonValue& JsonValue::at(int pos) const
+/* обновляет позиции детей после вставок и удалений */
+void JsonValue::renumberChildren () const
 {
-    if (pos < 0 || pos >= (int)this->size()) return _dummyValue;
+    size_t n = 0;
+    switch (type ())
+    {
+    case OBJECT:
+        for (const auto& p : *_value._o) p.second.setSlot (n++);
+        break;
 
-    switch (_type)
+    case ARRAY:
+        for (const auto& rv : * (_value._a)) rv.setSlot (n++);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*
+ * Подъём идёт до самого корня: у контейнера из арены кэша нет, а его
+ * предки в куче (поддерево перенесено туда перемещением) свой кэш имеют.
+ * reset без кэша -- одно чтение, так что цена -- глубина узла
+ */
+void JsonValue::dropMemo () const
+{
+    for (const JsonValue* p = this; p; p = p->parent ())
+    {
+        const JsonMemo* memo = memoOf (*p);
+        if (memo) memo->reset ();
+    }
+}
+
+const JsonValue& JsonValue::at(size_t pos) const
+{
+    if (pos >= this->size()) return _dummyValue;
+
+    switch (type ())
     {
     case ARRAY:
         return _value._a->operator[](pos);
@@ -1099,9 +2068,7 @@ const JsonValue& JsonValue::at(int pos) const
 
     case OBJECT:
     {
-        ObjectContainer::iterator i = _value._o->begin();
-        std::advance(i, pos);
-        return i->second;
+        return _value._o->nth(pos)->second;
     }
     break;
 
@@ -1113,12 +2080,30 @@ const JsonValue& JsonValue::at(int pos) const
 
 std::string JsonValue::getPointer() const
 {
-    std::string ptr;
-    const JsonValue* v = this;
-    while (v && v->_parent)
+    // сначала цепочка предков, потом ключи от корня в один буфер
+    std::vector<const JsonValue*> chain;
+    for (const JsonValue* v = this; v->parent (); v = v->parent ())
     {
-        ptr = "/" + v->key().asString() + ptr;
-        v = v->_parent;
+        chain.push_back (v);
+    }
+
+    std::string ptr;
+    char buf[32];
+    for (auto i = chain.rbegin (); i != chain.rend (); ++i)
+    {
+        const JsonValue* v = *i;
+        ptrdiff_t n = v->pos ();
+        ptr += '/';
+        if (n < 0) continue;
+        if (v->parent ()->type () == OBJECT)
+        {
+            ptr += v->parent ()->_value._o->nth(n)->first;
+        }
+        else
+        {
+            snprintf (buf, sizeof (buf), "%lld", (long long)n);
+            ptr += buf;
+        }
     }
     return ptr;
 }
@@ -1170,8 +2155,8 @@ bool JsonValue::isReference() const
 {
     return (
                (type() == JsonValue::STRING) &&
-               (_value._s->at(0) == '/') &&
-               (*(_value._s) != this->getPointer())
+               (stringSize () != 0 && stringData ()[0] == '/') &&
+               (asString() != this->getPointer())
                 );
 }
 
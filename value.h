@@ -1,10 +1,16 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <atomic>
 #include <map>
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <functional>
+
+#include "arena.h"
+#include "sink.h"
 
 // Если в качестве ArrayContainer используется std::vector
 // то ссылки и указатели на элементы контейнера могут стать не валидными
@@ -14,40 +20,115 @@
 // Определяя макрос
 #define USE_STABLE_ARRAY_CONTAINER
 // мы в качестве ArrayContainer начинаем использовать
-// собственный класс на базе std::list
+// собственный класс на базе ChunkedArray: элементы лежат блоками
+// и не переезжают, а доступ по индексу остаётся O(1)
 
 // Определяя макрос
 #define USE_STABLE_OBJECT_CONTAINER
 // мы в качестве ObjectContainer начинаем использовать
-// собственный класс на базе std::list
+// собственный класс на базе хеш-индекса поверх ChunkedArray:
+// порядок вставки и адреса значений сохраняются, поиск по ключу O(1)
+
+// Определяя макрос
+// #define USE_COMPACT_VALUE_LAYOUT
+// мы упаковываем узел в 16 байт вместо 32: тип и флаги хранятся
+// в свободных битах указателя на родителя, а встроенная строка
+// вмещает не 15, а 7 байт. Требует 64-битной платформы, где у
+// указателей пользовательского пространства старший байт нулевой
 
 class JsonValue;
 struct KeyValue;
 
+///
+/// \brief JsonKeyLess порядок ключей канонической формы (RFC 8785):
+/// сравниваются кодовые единицы UTF-16, а не байты UTF-8. Отличается от
+/// побайтового только для символов U+E000..U+FFFF, которые идут после
+/// символов вне BMP (те в UTF-16 записываются суррогатами D800..DFFF)
+///
+struct JsonKeyLess
+{
+    bool operator() (const std::string& a, const std::string& b) const;
+};
+
+///
+/// \brief JsonMemo текст контейнера, запомненный memoStringify.
+/// Текст длиннее MAX_TEXT не хранится: такой контейнер помечается как
+/// большой и дальше пишется заново из кэшей своих элементов (пометка
+/// переживает изменения). Копия контейнера кэш не наследует; публикуется
+/// он как порядок ObjectContainer::sorted -- первый построивший, остальные
+/// выбрасывают
+///
+class JsonMemo
+{
+public:
+    enum { MAX_TEXT = 4096 };
+
+    JsonMemo () : _text (0) {}
+    JsonMemo (const JsonMemo&) : _text (0) {}
+    JsonMemo& operator= (const JsonMemo&) { reset (); return *this; }
+    ~JsonMemo () { reset (); }
+
+    /// запомненный текст или 0 (в том числе для большого контейнера)
+    const std::string* text () const
+    {
+        std::string* p = _text.load (std::memory_order_acquire);
+        return p == &_large ? 0 : p;
+    }
+    bool large () const { return _text.load (std::memory_order_acquire) == &_large; }
+    /// забирает text, если он не длиннее MAX_TEXT и кэш пуст;
+    /// \return то, что теперь в кэше, или 0, если контейнер большой
+    const std::string* set (std::string& text) const;
+    /// \return был ли кэш (пометка большого контейнера не сбрасывается)
+    bool reset () const;
+
+private:
+    mutable std::atomic<std::string*> _text;
+    static std::string _large;
+};
+
 #ifdef USE_STABLE_OBJECT_CONTAINER
-#include "linkedmap.h"
-typedef LinkedMap<std::string, JsonValue> ObjectContainer;
+#include "orderedhashmap.h"
+class ObjectContainer
+    : public OrderedHashMap<std::string, JsonValue, std::hash<std::string>,
+                            JsonAllocator<std::pair<const std::string, JsonValue> >,
+                            JsonKeyLess>
+{
+    typedef OrderedHashMap<std::string, JsonValue, std::hash<std::string>,
+                           JsonAllocator<std::pair<const std::string, JsonValue> >,
+                           JsonKeyLess> Base;
+public:
+    explicit ObjectContainer(JsonArena* arena = 0) : Base(allocator_type(arena)) {}
+
+    template<class InputIt>
+    ObjectContainer(InputIt first, InputIt last) : Base(first, last) {}
+
+    JsonArena* arena() const { return get_allocator().arena(); }
+    const JsonMemo& memo() const { return _memo; }
+
+private:
+    JsonMemo _memo;
+};
 #else
 typedef std::map<std::string, JsonValue> ObjectContainer;
 #endif
 
 #ifdef USE_STABLE_ARRAY_CONTAINER
-class ArrayContainer : public std::list<JsonValue>
+#include "chunkedarray.h"
+class ArrayContainer
+    : public ChunkedArray<JsonValue, JsonAllocator<JsonValue> >
 {
+    typedef ChunkedArray<JsonValue, JsonAllocator<JsonValue> > Base;
 public:
-    ArrayContainer() : std::list<JsonValue>() {}
+    explicit ArrayContainer(JsonArena* arena = 0) : Base(allocator_type(arena)) {}
 
     template<class InputIt>
-    ArrayContainer(InputIt first, InputIt last)
-        : std::list<JsonValue>(first, last)
-    {}
+    ArrayContainer(InputIt first, InputIt last) : Base(first, last) {}
 
-    JsonValue& operator[](size_t n)
-    {
-        auto it = begin();
-        std::advance(it, n);
-        return (*it);
-    };
+    JsonArena* arena() const { return get_allocator().arena(); }
+    const JsonMemo& memo() const { return _memo; }
+
+private:
+    JsonMemo _memo;
 };
 #else
 typedef std::vector<JsonValue> ArrayContainer;
@@ -55,6 +136,8 @@ typedef std::vector<JsonValue> ArrayContainer;
 
 class JsonValue
 {
+    friend class JsonBuilder;
+
 public:
     enum Type {UNDEFINED, BOOLEAN, NUMBER, INTEGER, STRING, ARRAY, OBJECT};
 
@@ -73,24 +156,24 @@ public:
     JsonValue (size_t v);
     JsonValue (double v);
     JsonValue (const char* v);
-    JsonValue (char* buffer, size_t size, bool itIsString = false);
+    JsonValue (const char* buffer, size_t size, bool itIsString = false);
     JsonValue (const std::string& v);
     JsonValue (std::string&& v);
 
     template<class InputIt>
     JsonValue(InputIt first, InputIt last)
-        : _type(ARRAY)
     {
+        setType(ARRAY);
         _value._a = new ArrayContainer(first, last);
-        for (auto& rv : * (_value._a)) rv._parent = this;
+        adoptChildren();
     }
 
     template<class T>
     JsonValue(const std::unordered_map<std::string, T>& v)
-        : _type(OBJECT)
     {
+        setType(OBJECT);
         _value._o = new ObjectContainer(v.begin(), v.end());
-        for (auto& p : *_value._o) p.second._parent = this;
+        adoptChildren();
     }
 
     Type type() const;
@@ -108,14 +191,24 @@ public:
     std::string asString (const std::string& defaultValue = "") const;
 
     std::string asEscapedString (const std::string& defaultValue = "") const;
+
+    /* байты строки без копирования (только для isString()):
+       данные завершаются нулём, но могут содержать нули и внутри */
+    const char* stringData () const;
+    size_t stringSize () const;
     bool hasKey (const std::string &str) const;
 
     JsonValue& operator[](const std::string& key);
     JsonValue& operator[](size_t key);
+    /* добавление и вставка за O(1) (не считая сдвига указателей при
+       вставке в середину); перегрузки с && забирают поддерево без копии */
     JsonValue& add(const JsonValue& v);
+    JsonValue& add(JsonValue&& v);
 
     bool insert(size_t pos, const JsonValue& v);
+    bool insert(size_t pos, JsonValue&& v);
     bool insert(size_t pos, const std::string& key, const JsonValue& v);
+    bool insert(size_t pos, const std::string& key, JsonValue&& v);
 
     const JsonValue& operator[] (const std::string& key) const;
     const JsonValue& operator[] (size_t key) const;
@@ -136,8 +229,34 @@ public:
 
     bool operator==(const JsonValue& id) const;
 
+    ///
+    /// \brief equals структурное сравнение: типы должны совпадать,
+    /// массивы сравниваются поэлементно, объекты -- без учёта порядка
+    /// членов. Останавливается на первом различии и не выделяет память.
+    ///
+    bool equals(const JsonValue& v) const;
+    ///
+    /// \brief hash согласован с equals (но не с "нестрогим" operator==
+    /// для значений разных типов); не зависит от порядка членов объекта
+    ///
+    size_t hash() const;
+
     std::string stringifyThis() const;
     std::string prettyStringifyThis() const;
+    ///
+    /// \brief serializedSize точная длина текста stringify (без отступов)
+    /// или prettyStringify с теми же отступами -- с учётом экранирования
+    /// и ширины чисел, но без построения самого текста. Порядок ключей
+    /// на длину не влияет. Годится для Content-Length и для выделения
+    /// буфера заранее
+    ///
+    size_t serializedSize() const;
+    size_t serializedSize(const std::string& indent,
+                          const std::string& indent0,
+                          const std::string& indent1,
+                          const std::string& eol) const;
+    /// то же для canonicalStringify
+    size_t canonicalSize() const;
 
     ObjectContainer* asObject () const;
     ArrayContainer* asArray () const;
@@ -145,19 +264,73 @@ public:
 private:
     void reset ();
 
-    Type _type;
+    /* строка хранится одним блоком: длина и сами байты с нулём в конце */
+    struct StringData
+    {
+        size_t size;
+        char data[1];
+    };
+
+    // flags ()
+    enum
+    {
+        ARENA_STORAGE = 1,  // контейнер или строка лежат в арене, не освобождать
+        INLINE_STRING = 2   // строка лежит прямо в _value._c
+    };
+
+    void setToken (const char* buffer, size_t size, bool itIsString, JsonArena* arena);
+    void setString (const char* s, size_t size, JsonArena* arena);
+    void setContainer (Type type, JsonArena* arena);
+    void copyFrom (const JsonValue& v, JsonArena* arena);
+    JsonArena* storageArena () const;
+    void setStringSize (size_t size);
+
+    // доступ к полям, которые в компактном режиме упакованы вместе
+    void setType (Type type);
+    unsigned char flags () const;
+    void setFlags (unsigned char flags);
+    void setParent (const JsonValue* parent);
+    // позиция в контейнере-владельце по модулю 2^32 (подсказка для pos/key)
+    size_t slot () const;
+    void setSlot (size_t slot) const;
+    void adoptChildren ();
+    void renumberChildren () const;
+    // сбрасывает кэш memoStringify у контейнера и его предков
+    void dropMemo () const;
+
+#ifdef USE_COMPACT_VALUE_LAYOUT
+    // _meta: биты 0-2 -- тип (узлы выровнены по 8 байт),
+    // биты 3-55 -- указатель на родителя, биты 56-63 -- флаги
+    enum { TYPE_MASK = 7, FLAGS_SHIFT = 56 };
+    uintptr_t _meta = 0;
+#else
+    unsigned char _type = UNDEFINED;
+    unsigned char _flags = 0;
+    // pos() перенумеровывает соседей и из const-методов, возможно из
+    // нескольких потоков сразу: они пишут одни и те же значения
+    mutable std::atomic<uint32_t> _slot {0};
+#endif
 
     union _Value
     {
         ObjectContainer* _o;
         ArrayContainer* _a;
-        std::string* _s;
+        StringData* _s;
+        // короткие строки (до INLINE_CAPACITY байт) хранятся здесь,
+        // без отдельного выделения памяти
+#ifdef USE_COMPACT_VALUE_LAYOUT
+        char _c[8];
+#else
+        char _c[16];
+#endif
 
         bool _l;
         long long _i;
         double _d;
     } _value;
 
+    enum { INLINE_CAPACITY = sizeof (_Value) - 1 };
+
     static const JsonValue _dummyValue;
 
 public:
@@ -199,20 +372,23 @@ public:
 
     /////////////////////////////////////////////////////////////////////////
     // Набор для поддержания двунаправленной иерархии
+#ifndef USE_COMPACT_VALUE_LAYOUT
 private:
-    const JsonValue* _parent;
+    const JsonValue* _parent = 0;
+#endif
 
 public:
     // возвращает указатель на контейнер-владелец
     const JsonValue* parent() const;
     // возвращает указатель на самый верхний контейнер-владелец
     const JsonValue* root() const;
-    // возвращает ключ в контейнере-владельце
+    // возвращает ключ в контейнере-владельце, O(1)
+    // (в объекте, из которого удаляли ключи, -- O(n), см. OrderedHashMap)
     JsonValue key() const;
-    // возвращает позицию в контейнере-владельце
-    int pos() const;
+    // возвращает позицию в контейнере-владельце, O(1); -1, если владельца нет
+    ptrdiff_t pos() const;
     // возвращает элемент контейнера в позиции pos
-    const JsonValue& at(int pos) const;
+    const JsonValue& at(size_t pos) const;
 
     ////////////////////////////////////////////////////////////////////////
     // https://tools.ietf.org/html/rfc6901
@@ -254,6 +430,109 @@ private:
     bool isReference() const;
 };
 
+#ifdef USE_COMPACT_VALUE_LAYOUT
+static_assert (sizeof (void*) == 8, "USE_COMPACT_VALUE_LAYOUT requires 64-bit pointers");
+
+inline JsonValue::Type JsonValue::type () const
+{
+    return (Type)(_meta & TYPE_MASK);
+}
+
+inline void JsonValue::setType (Type type)
+{
+    _meta = (_meta & ~(uintptr_t)TYPE_MASK) | (uintptr_t)type;
+}
+
+inline unsigned char JsonValue::flags () const
+{
+    return (unsigned char)(_meta >> FLAGS_SHIFT);
+}
+
+inline void JsonValue::setFlags (unsigned char flags)
+{
+    _meta = (_meta & (((uintptr_t)1 << FLAGS_SHIFT) - 1)) |
+            ((uintptr_t)flags << FLAGS_SHIFT);
+}
+
+inline const JsonValue* JsonValue::parent () const
+{
+    return (const JsonValue*)(_meta & (((uintptr_t)1 << FLAGS_SHIFT) - 1) &
+                              ~(uintptr_t)TYPE_MASK);
+}
+
+inline void JsonValue::setParent (const JsonValue* parent)
+{
+    _meta = (_meta & ~((((uintptr_t)1 << FLAGS_SHIFT) - 1) & ~(uintptr_t)TYPE_MASK)) |
+            (uintptr_t)parent;
+}
+
+// в 16 байтах места под позицию нет: pos() ищет её перебором
+inline size_t JsonValue::slot () const
+{
+    return 0;
+}
+
+inline void JsonValue::setSlot (size_t) const
+{
+}
+#else
+inline JsonValue::Type JsonValue::type () const
+{
+    return (Type)_type;
+}
+
+inline void JsonValue::setType (Type type)
+{
+    _type = type;
+}
+
+inline unsigned char JsonValue::flags () const
+{
+    return _flags;
+}
+
+inline void JsonValue::setFlags (unsigned char flags)
+{
+    _flags = flags;
+}
+
+inline const JsonValue* JsonValue::parent () const
+{
+    return _parent;
+}
+
+inline void JsonValue::setParent (const JsonValue* parent)
+{
+    _parent = parent;
+}
+
+inline size_t JsonValue::slot () const
+{
+    return _slot.load (std::memory_order_relaxed);
+}
+
+inline void JsonValue::setSlot (size_t slot) const
+{
+    _slot.store ((uint32_t)slot, std::memory_order_relaxed);
+}
+#endif
+
+// std::unordered_set<JsonValue> и т.п. сравнивают значения через equals
+namespace std
+{
+template <>
+struct hash<JsonValue>
+{
+    size_t operator()(const JsonValue& v) const { return v.hash(); }
+};
+
+template <>
+struct equal_to<JsonValue>
+{
+    bool operator()(const JsonValue& a, const JsonValue& b) const { return a.equals(b); }
+};
+}
+
 struct KeyValue
 {
     JsonValue key;
@@ -264,11 +543,95 @@ struct KeyValue
     explicit KeyValue(JsonValue& v);
 };
 
-JsonValue parse_string (const char* string);
-JsonValue parse_buffer (char* buffer, size_t size);
-JsonValue parse_file (const char* fileName);
+// с arena все узлы документа размещаются в арене (см. JsonArena)
+JsonValue parse_string (const char* string, JsonArena* arena = 0);
+JsonValue parse_buffer (char* buffer, size_t size, JsonArena* arena = 0);
+// разбор никогда не пишет во входной буфер: годится память только для
+// чтения (разделяемая память, отображённые файлы, буферы приёма)
+JsonValue parse (const char* buffer, size_t size, JsonArena* arena = 0);
+// parse_file разбирает обычный файл прямо из отображения в память (mmap),
+// не копируя его
+JsonValue parse_file (const char* fileName, JsonArena* arena = 0);
+
+/* прежний двухпроходный разбор: jsmn_parse в массив токенов и обход токенов;
+   оставлен для сравнения с parse_buffer в бенчмарках */
+JsonValue parse_buffer_jsmn (const char* buffer, size_t size);
+
+///
+/// \brief JsonParser -- контекст разбора. Рабочая память (стек открытых
+/// контейнеров, буфер ключей, массив лексем jsmn) остаётся в нём между
+/// вызовами, так что поток небольших сообщений разбирается без
+/// malloc/free служебных структур на каждое.
+///
+/// Функции parse* пользуются контекстом своего потока (local) и после
+/// разбора оставляют ему не больше RETAIN байт каждой структуры.
+/// Один контекст -- один поток.
+///
+class JsonParser
+{
+public:
+    enum { RETAIN = 64 * 1024 };
+
+    JsonParser ();
+    ~JsonParser ();
+
+    /// то же, что parse(buffer, size, arena)
+    JsonValue parse (const char* buffer, size_t size, JsonArena* arena = 0);
+    /// то же, что parse_buffer_jsmn
+    JsonValue parseJsmn (const char* buffer, size_t size);
 
+    /// освобождает структуры, занимающие больше keep байт
+    void release (size_t keep = 0);
+
+    /// контекст текущего потока
+    static JsonParser& local ();
+
+private:
+    JsonParser (const JsonParser&) = delete;
+    JsonParser& operator= (const JsonParser&) = delete;
+
+    struct Storage;
+    Storage* _storage;
+};
+
+// sorted -- члены объектов в порядке JsonKeyLess
 std::string stringify (const JsonValue& v, bool sorted = false);
+void stringify (JsonSink& out, const JsonValue& v, bool sorted = false);
+
+/*
+ * Каноническая форма RFC 8785 (JSON Canonicalization Scheme) -- для
+ * хешей и подписей: члены в порядке JsonKeyLess, без пробелов, числа
+ * как в ECMAScript (кратчайшие, 1 вместо 1.0, 1e+21), '/' не
+ * экранируется. Порядок членов больших объектов кэшируется в самом
+ * объекте (ObjectContainer::sorted) до изменения набора ключей.
+ * NaN и бесконечности в JCS недопустимы и пишутся как null.
+ */
+std::string canonicalStringify (const JsonValue& v);
+void canonicalStringify (JsonSink& out, const JsonValue& v);
+
+/*
+ * То же, что stringify (без сортировки), но текст каждого контейнера
+ * запоминается в нём самом, а при следующем вызове неизменённые
+ * поддеревья копируются из кэша целиком. Кэш сбрасывается у узла и
+ * всех его предков при изменении через operator=, operator[] (если
+ * появился элемент), add, insert, erase и clear; правка контейнера
+ * напрямую через asObject()/asArray() не отслеживается. Документы в
+ * арене не кэшируются. Память: каждый уровень вложенности хранит
+ * свою копию текста.
+ */
+std::string memoStringify (const JsonValue& v);
+void memoStringify (JsonSink& out, const JsonValue& v);
+
+/*
+ * То же, что stringify (текст совпадает побайтно), но элементы корневого
+ * массива или члены корневого объекта пишутся кусками на threads потоках
+ * (0 -- по числу ядер). Небольшие документы пишутся обычным stringify.
+ * Во время вызова дерево нельзя менять.
+ */
+std::string parallelStringify (const JsonValue& v, bool sorted = false,
+                               unsigned threads = 0);
+void parallelStringify (JsonSink& out, const JsonValue& v, bool sorted = false,
+                        unsigned threads = 0);
 
 std::string
 prettyStringify (const JsonValue& v,
@@ -279,4 +642,16 @@ prettyStringify (const JsonValue& v,
                  bool sorted = false
                 );
 
+/* то же, но текст пишется в приёмник (строку, буфер, FILE*, дескриптор),
+   без промежуточных строк */
+void
+prettyStringify (JsonSink& out,
+                 const JsonValue& v,
+                 const std::string& indent = "  ",
+                 const std::string& indent0 = "",
+                 const std::string& indent1 = "  ",
+                 const std::string& eol = "\n",
+                 bool sorted = false
+                );
+
 #endif  // VALUE_H
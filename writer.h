@@ -0,0 +1,295 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+// Внутренний заголовок: общий обход дерева для stringify и его
+// вариантов (value.cpp) и для JsonStreamWriter (streamwriter.cpp)
+
+#include "value.h"
+#include "sink.h"
+#include "stringutils.h"
+#include "dtoa.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+///
+/// \brief JsonCounter вместо текста считает его длину: строки не
+/// копируются, а только просматриваются на предмет экранирования
+///
+struct JsonCounter
+{
+    size_t size;
+
+    JsonCounter () : size (0) {}
+
+    void put (char) { ++size; }
+    void write (const char*, size_t n) { size += n; }
+    void write (const std::string& s) { size += s.size (); }
+};
+
+inline void writeEscaped (JsonSink& out, const char* s, size_t size, bool escapeSlash)
+{
+    escape (out, s, size, escapeSlash);
+}
+
+inline void writeEscaped (JsonCounter& out, const char* s, size_t size, bool escapeSlash)
+{
+    out.size += escapedSize (s, size, escapeSlash);
+}
+
+/* длина текста от порядка ключей не зависит, сортировать при подсчёте незачем */
+inline bool ordered (const JsonSink&) { return true; }
+inline bool ordered (const JsonCounter&) { return false; }
+
+/* кэш memoStringify контейнера или 0: контейнеры арены не разрушаются
+   по одному, и кэш в них утёк бы */
+inline const JsonMemo* memoOf (const JsonValue& v)
+{
+    switch (v.type ())
+    {
+#ifdef USE_STABLE_ARRAY_CONTAINER
+    case JsonValue::Type::ARRAY :
+        return v.asArray ()->arena () ? 0 : &v.asArray ()->memo ();
+#endif
+#ifdef USE_STABLE_OBJECT_CONTAINER
+    case JsonValue::Type::OBJECT :
+        return v.asObject ()->arena () ? 0 : &v.asObject ()->memo ();
+#endif
+    default:
+        return 0;
+    }
+}
+
+///
+/// \brief JsonWriter выводит дерево в JsonSink (или JsonCounter) одним проходом.
+///
+/// Отступы: члены контейнера глубины d идут с отступом
+/// indent1 + d * indent, закрывающая скобка -- с indent0 на верхнем
+/// уровне и с indent1 + (d - 1) * indent глубже.
+///
+template <class Out>
+class JsonWriter
+{
+public:
+    JsonWriter (Out& out, const std::string& indent,
+                const std::string& indent0, const std::string& indent1,
+                const std::string& eol, bool sorted, bool canonical = false,
+                bool memo = false)
+        : _out(out), _indent(indent), _indent0(indent0), _indent1(indent1),
+          _eol(eol), _sorted((sorted || canonical) && ordered (out)), _canonical(canonical),
+          _memo(memo)
+    {
+    }
+
+    void write (const JsonValue& v, size_t depth = 0)
+    {
+        char buf[64];
+
+        switch (v.type())
+        {
+        case JsonValue::Type::UNDEFINED :
+            _out.write ("null", 4);
+            break;
+
+        case JsonValue::Type::BOOLEAN :
+            if (v.asBoolean ()) _out.write ("true", 4);
+            else _out.write ("false", 5);
+            break;
+
+        case JsonValue::Type::INTEGER :
+            _out.write (buf, formatInteger (buf, v.asInt ()));
+            break;
+
+        case JsonValue::Type::NUMBER :
+        {
+            double d = v.asNumber ();
+            if (!_canonical || (d * 0) != 0) _out.write (buf, formatNumber (buf, d));
+            else _out.write (buf, formatEcmaScript (buf, d));
+            break;
+        }
+
+        case JsonValue::Type::STRING :
+            writeString (v.stringData (), v.stringSize ());
+            break;
+
+        case JsonValue::Type::ARRAY :
+        case JsonValue::Type::OBJECT :
+            if (!_memo || !writeMemo (v)) writeContainer (v, depth);
+            break;
+        }
+    }
+
+    void writeContainer (const JsonValue& v, size_t depth)
+    {
+        if (v.type () == JsonValue::Type::ARRAY)
+        {
+            open ('[');
+            size_t i = 0;
+            for (const auto& a : *v.asArray())
+            {
+                if (i++) separator ();
+                indent (depth);
+                write (a, depth + 1);
+            }
+            close (depth, ']');
+            return;
+        }
+
+        open ('{');
+        const ObjectContainer& oc = *v.asObject();
+        if (_sorted)
+        {
+            const ObjectContainer::value_type* small[SMALL_OBJECT];
+            std::vector<const ObjectContainer::value_type*> large;
+            const ObjectContainer::value_type* const* members =
+                sortedMembers (oc, small, large);
+            for (size_t i = 0; i < oc.size (); ++i)
+            {
+                if (i) separator ();
+                member (*members[i], depth);
+            }
+        }
+        else
+        {
+            size_t i = 0;
+            for (const auto& p : oc)
+            {
+                if (i++) separator ();
+                member (p, depth);
+            }
+        }
+        close (depth, '}');
+    }
+
+    enum { SMALL_OBJECT = 16 };
+
+    /*
+     * Члены объекта в порядке JsonKeyLess. Маленькие объекты сортируются
+     * вставками на стеке, порядок больших берётся из кэша контейнера
+     */
+    static const ObjectContainer::value_type* const*
+    sortedMembers (const ObjectContainer& oc,
+                   const ObjectContainer::value_type** small,
+                   std::vector<const ObjectContainer::value_type*>& large)
+    {
+        JsonKeyLess less;
+        if (oc.size () <= SMALL_OBJECT)
+        {
+            size_t n = 0;
+            for (const auto& p : oc)
+            {
+                size_t i = n++;
+                for (; i > 0 && less (p.first, small[i - 1]->first); --i)
+                    small[i] = small[i - 1];
+                small[i] = &p;
+            }
+            return small;
+        }
+#ifdef USE_STABLE_OBJECT_CONTAINER
+        (void)large;
+        return oc.sorted ();
+#else
+        large.reserve (oc.size ());
+        for (const auto& p : oc) large.push_back (&p);
+        std::sort (large.begin (), large.end (),
+                   [&less](const ObjectContainer::value_type* a,
+                           const ObjectContainer::value_type* b)
+        {
+            return less (a->first, b->first);
+        });
+        return large.data ();
+#endif
+    }
+
+    /* в канонической форме целые -- это тоже double */
+    size_t formatInteger (char* buf, long long i)
+    {
+        const long long exact = 1LL << 53;
+        if (_canonical && (i > exact || i < -exact))
+            return formatEcmaScript (buf, (double)i);
+        return formatNumber (buf, i);
+    }
+
+    void member (const ObjectContainer::value_type& p, size_t depth)
+    {
+        indent (depth);
+        writeString (p.first.data (), p.first.size ());
+        _out.put (':');
+        write (p.second, depth + 1);
+    }
+
+    /* куски разметки -- ими же пишет JsonStreamWriter */
+    void open (char bracket)
+    {
+        _out.put (bracket);
+        _out.write (_eol);
+    }
+
+    void writeString (const char* s, size_t size)
+    {
+        _out.put ('\"');
+        writeEscaped (_out, s, size, !_canonical);
+        _out.put ('\"');
+    }
+
+    void separator ()
+    {
+        _out.put (',');
+        _out.write (_eol);
+    }
+
+    void indent (size_t depth)
+    {
+        _out.write (_indent1);
+        if (_indent.empty ()) return;
+        for (size_t i = 0; i < depth; ++i) _out.write (_indent);
+    }
+
+    void close (size_t depth, char bracket)
+    {
+        _out.write (_eol);
+        if (depth == 0) _out.write (_indent0);
+        else indent (depth - 1);
+        _out.put (bracket);
+    }
+
+private:
+    /*
+     * Текст контейнера из его кэша; если кэша нет, контейнер пишется
+     * отдельно (вложенные при этом тоже запоминаются) и текст
+     * запоминается. Большие контейнеры пишутся как обычно -- из кэшей
+     * элементов. Кэш хранит только компактную форму без сортировки
+     */
+    bool writeMemo (const JsonValue& v)
+    {
+        const JsonMemo* memo = memoOf (v);
+        if (memo == 0 || memo->large ()) return false;
+
+        std::string s;
+        const std::string* text = memo->text ();
+        if (text == 0)
+        {
+            JsonStringSink out (s);
+            JsonWriter<JsonSink> writer (out, _indent, _indent0, _indent1, _eol,
+                                         false, false, true);
+            writer.writeContainer (v, 0);
+            out.flush ();
+            text = memo->set (s);
+            if (text == 0) text = &s;
+        }
+        _out.write (*text);
+        return true;
+    }
+
+    Out& _out;
+    const std::string& _indent;
+    const std::string& _indent0;
+    const std::string& _indent1;
+    const std::string& _eol;
+    bool _sorted;
+    bool _canonical;
+    bool _memo;
+};
+
+#endif // WRITER_H